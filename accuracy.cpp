@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "autotuner.hpp"
+#include "barnes_hut.hpp"
+#include "force_solver.hpp"
+#include "option_parsing.hpp"
+#include "scenarios.hpp"
+#include "task_graph.hpp"
+
+// Accuracy versus cost of the force solvers. For every scenario and body count, accelerations of
+// every solver setting are compared with the direct sum in double precision, and the time of one
+// force pass (tree build included) is measured. Writes one CSV row per setting and prints the
+// Pareto front of time against 99th percentile error, plus the cheapest setting within the budget.
+// Built by 'make accuracy'.
+//
+// Options, all optional:
+//   --scenarios uniform,cluster,disk,collision,clumps
+//   --sizes 1000,5000
+//   --thetas 0.2,0.3,0.4,0.5,0.6,0.7,0.8,1.0    Barnes-Hut opening angles
+//   --leaf-sizes 4,8,16,32
+//   --threads 1                                 threads of the force pass
+//   --budget 0.01                               error budget (99th percentile, relative)
+//   --out accuracy.csv
+
+static const char* const DEFAULT_OUTPUT = "accuracy.csv";
+// Settings are timed this often, keeping the fastest, unless a single pass is already this slow
+static const unsigned int TIMING_REPEATS = 3;
+static const double SLOW_PASS_SECONDS = 0.5;
+
+struct AccuracyOptions {
+    std::vector<Scenario> scenarios;
+    std::vector<size_t> sizes = {1000, 5000};
+    std::vector<double> thetas = {0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 1.0};
+    std::vector<unsigned int> leafSizes = {4, 8, 16, 32};
+    unsigned int threads = 1;
+    double budget = AUTOTUNE_ERROR_BUDGET;
+    std::string output = DEFAULT_OUTPUT;
+};
+
+// One solver setting measured on one scene
+struct SettingResult {
+    SolverConfig config;
+    double milliseconds;
+    double errors[4]; // Relative error percentiles, see ERROR_PERCENTILES
+    bool pareto;
+};
+
+static const double ERROR_PERCENTILES[] = {50.0, 90.0, 99.0, 100.0};
+static const unsigned int P99 = 2;
+
+static bool parseOptions(int argc, char** argv, AccuracyOptions& options) {
+    options.scenarios.assign(SCENARIOS, SCENARIOS + SCENARIO_COUNT);
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        std::vector<double> reals;
+        std::vector<unsigned int> numbers;
+        if (std::strcmp(option, "--scenarios") == 0) {
+            if (!parseScenarioList(value, options.scenarios)) return false;
+        } else if (std::strcmp(option, "--sizes") == 0) {
+            if (!parseNumberList(value, options.sizes)) return false;
+        } else if (std::strcmp(option, "--thetas") == 0) {
+            if (!parseRealList(value, options.thetas)) return false;
+        } else if (std::strcmp(option, "--leaf-sizes") == 0) {
+            if (!parseNumberList(value, options.leafSizes)) return false;
+        } else if (std::strcmp(option, "--threads") == 0) {
+            if (!parseNumberList(value, numbers) || numbers.size() != 1) return false;
+            options.threads = numbers[0];
+        } else if (std::strcmp(option, "--budget") == 0) {
+            if (!parseRealList(value, reals) || reals.size() != 1) return false;
+            options.budget = reals[0];
+        } else if (std::strcmp(option, "--out") == 0) {
+            options.output = value;
+        } else {
+            std::cerr << "Unknown option " << option << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static SettingResult measure(const SolverConfig& config, std::vector<Sphere>& spheres, const std::vector<glm::dvec3>& reference,
+                             BarnesHutTree& tree, WorkerPool& pool) {
+    SettingResult result = {config, 0.0, {}, false};
+    double total = 0.0;
+    for (unsigned int repeat = 0; repeat < TIMING_REPEATS && total < SLOW_PASS_SECONDS; repeat++) {
+        auto start = std::chrono::steady_clock::now();
+        if (config.solver == ForceSolver::BarnesHut) tree.build(spheres, config.leafSize);
+        computeForcesParallel(pool, spheres, spheres.size(), config, tree);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        total += elapsed.count();
+        if (repeat == 0 || elapsed.count() * 1e3 < result.milliseconds) result.milliseconds = elapsed.count() * 1e3;
+    }
+
+    std::vector<double> errors;
+    errors.reserve(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        double magnitude = glm::length(reference[i]);
+        // Bodies without any pull cannot have a relative error
+        if (magnitude == 0.0) continue;
+        errors.push_back(glm::length(glm::dvec3(spheres[i].acc) - reference[i]) / magnitude);
+    }
+    std::sort(errors.begin(), errors.end());
+    for (unsigned int p = 0; p < 4; p++) {
+        result.errors[p] = errors.empty() ? 0.0 : errors[size_t((errors.size() - 1) * ERROR_PERCENTILES[p] / 100.0)];
+    }
+    return result;
+}
+
+// A setting is on the front if no other one is at least as fast and as accurate, and better in one
+static void markParetoFront(std::vector<SettingResult>& results) {
+    for (SettingResult &candidate : results) {
+        candidate.pareto = true;
+        for (const SettingResult &other : results) {
+            bool noWorse = other.milliseconds <= candidate.milliseconds && other.errors[P99] <= candidate.errors[P99];
+            bool better = other.milliseconds < candidate.milliseconds || other.errors[P99] < candidate.errors[P99];
+            if (noWorse && better) {
+                candidate.pareto = false;
+                break;
+            }
+        }
+    }
+}
+
+static void printSetting(const SettingResult& result) {
+    std::cout << "  " << solverName(result.config.solver);
+    if (result.config.solver == ForceSolver::BarnesHut) {
+        std::cout << " theta " << result.config.theta << " leaf " << result.config.leafSize;
+    }
+    std::cout << ": " << result.milliseconds << " ms, p99 error " << result.errors[P99] << "\n";
+}
+
+int main(int argc, char** argv) {
+    AccuracyOptions options;
+    if (!parseOptions(argc, argv, options) || options.threads == 0) {
+        std::cerr << "Usage: " << argv[0] << " [--scenarios a,b] [--sizes n,m] [--thetas a,b] [--leaf-sizes a,b]"
+                  << " [--threads n] [--budget e] [--out file.csv]\n";
+        return 1;
+    }
+
+    std::ofstream csv(options.output);
+    if (!csv) {
+        std::cerr << "Failed to write " << options.output << "\n";
+        return 1;
+    }
+    csv << "scenario,bodies,solver,theta,leaf_size,threads,ms_per_step,error_p50,error_p90,error_p99,error_max,pareto\n";
+
+    WorkerPool pool(options.threads - 1);
+    BarnesHutTree tree;
+    for (Scenario scenario : options.scenarios) {
+        for (size_t bodies : options.sizes) {
+            std::vector<Sphere> spheres = generateScenario(scenario, bodies);
+            std::vector<glm::dvec3> reference(spheres.size());
+            for (size_t i = 0; i < spheres.size(); i++) reference[i] = referenceAcceleration(spheres, i);
+
+            // The direct sum in float is a setting too: its error is the floor for everything else
+            std::vector<SettingResult> results;
+            results.push_back(measure(SolverConfig(), spheres, reference, tree, pool));
+            for (double theta : options.thetas) {
+                for (unsigned int leafSize : options.leafSizes) {
+                    SolverConfig config;
+                    config.solver = ForceSolver::BarnesHut;
+                    config.theta = theta;
+                    config.leafSize = leafSize;
+                    results.push_back(measure(config, spheres, reference, tree, pool));
+                }
+            }
+            markParetoFront(results);
+
+            std::sort(results.begin(), results.end(), [](const SettingResult& a, const SettingResult& b) {
+                return a.milliseconds < b.milliseconds;
+            });
+            const SettingResult* cheapest = nullptr;
+            for (const SettingResult &result : results) {
+                csv << scenarioName(scenario) << "," << bodies << "," << solverName(result.config.solver) << ",";
+                // Tree parameters stay empty for the direct sum
+                if (result.config.solver == ForceSolver::BarnesHut) csv << result.config.theta << "," << result.config.leafSize;
+                else csv << ",";
+                csv << "," << options.threads << "," << result.milliseconds;
+                for (double error : result.errors) csv << "," << error;
+                csv << "," << (result.pareto ? 1 : 0) << "\n";
+                if (!cheapest && result.errors[P99] <= options.budget) cheapest = &result;
+            }
+            csv.flush();
+
+            std::cout << scenarioName(scenario) << ", " << bodies << " bodies, Pareto front:\n";
+            for (const SettingResult &result : results) {
+                if (result.pareto) printSetting(result);
+            }
+            std::cout << "Cheapest within p99 error " << options.budget << ":\n";
+            if (cheapest) printSetting(*cheapest);
+            else std::cout << "  none\n";
+        }
+    }
+    return 0;
+}
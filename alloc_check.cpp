@@ -0,0 +1,163 @@
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+#include "option_parsing.hpp"
+#include "physics_thread.hpp"
+#include "scenarios.hpp"
+#include "visible_instances.hpp"
+
+// Allocation check: steps every scenario headless past a warmup and fails if any task of the physics
+// graph allocates after it. Meanwhile the calling thread does the per-frame render work that needs no
+// GL context, i.e. picking up the newest snapshot and culling it into instances, and fails if that
+// allocates after the warmup either. Autotuning is on with a short re-tune interval, so the check also
+// covers re-tunes spread over steps, and periodic checkpoints are written to alloc_check.ckpt, which is
+// removed afterwards. Exits with 1 on any allocation. Built and run by 'make alloc-check'.
+//
+// Options, all optional:
+//   --scenarios uniform,cluster,disk,collision,clumps
+//   --bodies 1000
+//   --warmup 120            steps in which buffers may still grow
+//   --steps 360             steps checked after the warmup
+//   --threads 3
+//   --autotune 150          steps between re-tunes, or off
+//   --checkpoints 100       steps between checkpoints, or off
+
+struct AllocCheckOptions {
+    std::vector<Scenario> scenarios;
+    size_t bodies = 1000;
+    uint64_t warmup = 120;
+    uint64_t steps = 360;
+    unsigned int threads = 3;
+    uint64_t autotune = 150;
+    uint64_t checkpoints = 100;
+};
+
+static const char* const CHECKPOINT_PATH = "alloc_check.ckpt";
+
+static bool parseOptions(int argc, char** argv, AllocCheckOptions& options) {
+    options.scenarios.assign(SCENARIOS, SCENARIOS + SCENARIO_COUNT);
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        std::vector<uint64_t> numbers;
+        if (std::strcmp(option, "--scenarios") == 0) {
+            if (!parseScenarioList(value, options.scenarios)) return false;
+            continue;
+        }
+        if (std::strcmp(value, "off") == 0 && std::strcmp(option, "--autotune") == 0) {
+            options.autotune = 0;
+            continue;
+        }
+        if (std::strcmp(value, "off") == 0 && std::strcmp(option, "--checkpoints") == 0) {
+            options.checkpoints = 0;
+            continue;
+        }
+        if (!parseNumberList(value, numbers) || numbers.size() != 1) return false;
+        if (std::strcmp(option, "--bodies") == 0) options.bodies = numbers[0];
+        else if (std::strcmp(option, "--warmup") == 0) options.warmup = numbers[0];
+        else if (std::strcmp(option, "--steps") == 0) options.steps = numbers[0];
+        else if (std::strcmp(option, "--threads") == 0) options.threads = unsigned(numbers[0]);
+        else if (std::strcmp(option, "--autotune") == 0) options.autotune = numbers[0];
+        else if (std::strcmp(option, "--checkpoints") == 0) options.checkpoints = numbers[0];
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// One scenario; prints what allocated and returns false if anything did
+static bool checkScenario(Scenario scenario, const AllocCheckOptions& options) {
+    std::vector<Sphere> spheres = generateScenario(scenario, options.bodies);
+    size_t bodyCount = spheres.size();
+    PhysicsThread physics;
+    if (options.autotune) physics.setAutotune(scenarioName(scenario), options.autotune);
+    if (options.checkpoints) physics.setCheckpoints(CHECKPOINT_PATH, options.checkpoints);
+
+    // Render-side buffers sized up front, as main() does
+    std::vector<unsigned char> sphereLod;
+    sphereLod.reserve(bodyCount);
+    std::vector<InstanceData> instances(bodyCount);
+    unsigned int lodFirst[SPHERE_LOD_COUNT];
+    unsigned int lodCount[SPHERE_LOD_COUNT];
+    glm::mat4 view = glm::lookAt(glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, -1.f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.f / 9.f, 0.1f, 100.0f);
+    Frustum frustum = extractFrustum(projection * view);
+    float pixelsPerUnit = projection[1][1] * 1080 * 0.5f;
+
+    uint64_t totalSteps = options.warmup + options.steps;
+    std::atomic<bool> done(false);
+    std::thread stepping([&] {
+        physics.run(std::move(spheres), totalSteps, options.threads - 1);
+        done = true;
+    });
+
+    std::vector<AllocationCounts> warmTasks; // Per task, as of the end of the warmup
+    AllocationCounts warmRender;
+    uint64_t measuredFrom = 0;
+    uint64_t frames = 0;
+    while (!done) {
+        physics.snapshots().acquire();
+        const PhysicsSnapshot &snapshot = physics.snapshots().readBuffer();
+        if (measuredFrom == 0 && snapshot.step >= options.warmup) {
+            const TaskGraph &graph = *physics.taskGraph();
+            // Sized before this thread's own count is taken
+            warmTasks.resize(graph.taskCount());
+            for (unsigned int task = 0; task < graph.taskCount(); task++) warmTasks[task] = graph.taskAllocations(task);
+            measuredFrom = snapshot.step;
+            warmRender = threadAllocationCounts();
+        }
+        writeVisibleInstances(snapshot.bodies, frustum, view, pixelsPerUnit, sphereLod, instances.data(), lodFirst, lodCount);
+        if (measuredFrom) frames++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stepping.join();
+    if (options.checkpoints) std::remove(CHECKPOINT_PATH);
+    AllocationCounts render = threadAllocationCounts() - warmRender;
+
+    std::cout << scenarioName(scenario) << ":";
+    // Stepping may outrun this thread; a window that saw too few steps proves nothing
+    if (measuredFrom == 0 || totalSteps - measuredFrom < options.steps / 2) {
+        std::cout << " stepping finished before the check could start, run with more --steps\n";
+        return false;
+    }
+    bool clean = render.allocations == 0;
+    const TaskGraph &graph = *physics.taskGraph();
+    for (unsigned int task = 0; task < graph.taskCount(); task++) {
+        AllocationCounts made = graph.taskAllocations(task) - warmTasks[task];
+        if (made.allocations == 0) continue;
+        std::cout << " " << graph.taskName(task) << " " << made.allocations << "/" << made.bytes << " bytes";
+        clean = false;
+    }
+    if (render.allocations) std::cout << " render " << render.allocations << "/" << render.bytes << " bytes";
+    std::cout << (clean ? " no allocations" : " allocated") << " in steps " << measuredFrom << "-" << totalSteps << " and "
+              << frames << " frames\n";
+    return clean;
+}
+
+int main(int argc, char** argv) {
+    AllocCheckOptions options;
+    if (!parseOptions(argc, argv, options) || options.threads == 0) {
+        std::cerr << "Usage: " << argv[0] << " [--scenarios a,b] [--bodies n] [--warmup n] [--steps n] [--threads n] [--autotune n|off] [--checkpoints n|off]\n";
+        return 1;
+    }
+
+    bool clean = true;
+    for (Scenario scenario : options.scenarios) clean = checkScenario(scenario, options) && clean;
+    std::cout << (clean ? "Steady state is allocation-free\n" : "FAILED: steady state allocates\n");
+    return clean ? 0 : 1;
+}
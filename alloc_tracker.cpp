@@ -0,0 +1,175 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+
+// Call-site table size. Open addressing; sites beyond this are dropped
+static const unsigned int SAMPLE_SLOTS = 512;
+
+struct AllocationSample {
+    std::atomic<void*> site{nullptr};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+// Plain thread_local PODs: constant-initialized, so counting never allocates or runs constructors
+static thread_local uint64_t threadAllocations = 0;
+static thread_local uint64_t threadFrees = 0;
+static thread_local uint64_t threadBytes = 0;
+static thread_local unsigned int untilSample = 0;
+
+static std::atomic<uint64_t> processAllocations{0};
+static std::atomic<uint64_t> processFrees{0};
+static std::atomic<uint64_t> processBytes{0};
+static std::atomic<unsigned int> sampleInterval{0};
+static AllocationSample samples[SAMPLE_SLOTS];
+
+static void recordSample(void* site, size_t size) {
+    unsigned int slot = (reinterpret_cast<uintptr_t>(site) >> 4) % SAMPLE_SLOTS;
+    for (unsigned int probe = 0; probe < SAMPLE_SLOTS; probe++) {
+        AllocationSample &sample = samples[(slot + probe) % SAMPLE_SLOTS];
+        void* current = sample.site.load(std::memory_order_relaxed);
+        if (current == nullptr && sample.site.compare_exchange_strong(current, site, std::memory_order_relaxed)) current = site;
+        if (current != site) continue;
+        sample.count.fetch_add(1, std::memory_order_relaxed);
+        sample.bytes.fetch_add(size, std::memory_order_relaxed);
+        return;
+    }
+}
+
+static void countAllocation(size_t size, void* site) {
+    threadAllocations++;
+    threadBytes += size;
+    processAllocations.fetch_add(1, std::memory_order_relaxed);
+    processBytes.fetch_add(size, std::memory_order_relaxed);
+
+    unsigned int interval = sampleInterval.load(std::memory_order_relaxed);
+    if (interval == 0) return;
+    if (untilSample == 0 || untilSample > interval) untilSample = interval;
+    if (--untilSample == 0) recordSample(site, size);
+}
+
+static void countFree(void* pointer) {
+    if (pointer == nullptr) return;
+    threadFrees++;
+    processFrees.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* allocate(size_t size, void* site) {
+    countAllocation(size, site);
+    void* pointer = malloc(size ? size : 1);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+static void* allocateAligned(size_t size, std::align_val_t alignment, void* site) {
+    countAllocation(size, site);
+    size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc needs a size that is a multiple of the alignment
+    void* pointer = aligned_alloc(align, (size + align - 1) / align * align);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+// The return address of operator new is the code that asked for the memory
+#define CALL_SITE __builtin_return_address(0)
+
+void* operator new(size_t size) { return allocate(size, CALL_SITE); }
+void* operator new[](size_t size) { return allocate(size, CALL_SITE); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment, CALL_SITE); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment, CALL_SITE); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size, CALL_SITE); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size, CALL_SITE); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* pointer) noexcept { countFree(pointer); free(pointer); }
+void operator delete[](void* pointer) noexcept { countFree(pointer); free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { countFree(pointer); free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { countFree(pointer); free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { countFree(pointer); free(pointer); }
+
+AllocationCounts threadAllocationCounts() {
+    return {threadAllocations, threadFrees, threadBytes};
+}
+
+AllocationCounts processAllocationCounts() {
+    return {processAllocations.load(std::memory_order_relaxed), processFrees.load(std::memory_order_relaxed),
+            processBytes.load(std::memory_order_relaxed)};
+}
+
+void setAllocationSampling(unsigned int interval) {
+    sampleInterval = interval;
+}
+
+void printAllocationSamples(std::ostream& out) {
+    struct Site {
+        void* address;
+        uint64_t count;
+        uint64_t bytes;
+    };
+    std::vector<Site> sites;
+    for (const AllocationSample &sample : samples) {
+        void* site = sample.site.load(std::memory_order_relaxed);
+        if (site) sites.push_back({site, sample.count.load(std::memory_order_relaxed), sample.bytes.load(std::memory_order_relaxed)});
+    }
+    std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.count > b.count; });
+
+    out << "Sampled allocation sites (1 in " << sampleInterval.load() << " allocations):\n";
+    for (const Site &site : sites) {
+        // Symbol names need -rdynamic for the executable itself; otherwise use addr2line on the address
+        Dl_info info;
+        const char* symbol = dladdr(site.address, &info) && info.dli_sname ? info.dli_sname : "?";
+        out << "  " << site.count << " samples, " << site.bytes << " bytes at " << site.address << " " << symbol << "\n";
+    }
+}
+
+void AllocationPhases::begin() {
+    phaseCount = 0;
+    last = threadAllocationCounts();
+}
+
+void AllocationPhases::mark(const char* name) {
+    AllocationCounts now = threadAllocationCounts();
+    if (phaseCount < MAX_PHASES) {
+        names[phaseCount] = name;
+        counts[phaseCount] = now - last;
+        phaseCount++;
+    }
+    last = now;
+}
+
+AllocationCounts AllocationPhases::total() const {
+    AllocationCounts sum;
+    for (unsigned int i = 0; i < phaseCount; i++) {
+        sum.allocations += counts[i].allocations;
+        sum.frees += counts[i].frees;
+        sum.bytes += counts[i].bytes;
+    }
+    return sum;
+}
+
+void AllocationPhases::print(std::ostream& out) const {
+    AllocationCounts sum = total();
+    out << sum.allocations << " allocations, " << sum.bytes << " bytes (";
+    bool first = true;
+    for (unsigned int i = 0; i < phaseCount; i++) {
+        if (counts[i].allocations == 0) continue;
+        out << (first ? "" : ", ") << names[i] << " " << counts[i].allocations << "/" << counts[i].bytes;
+        first = false;
+    }
+    out << ")";
+}
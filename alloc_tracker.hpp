@@ -0,0 +1,54 @@
+#ifndef ALLOC_TRACKER_HPP
+#define ALLOC_TRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Allocation tracking through replaced global operator new/delete (alloc_tracker.cpp).
+// Every allocation is counted per thread and process-wide; optionally every Nth one also records
+// its call site. Only C++ allocations are seen: malloc from C libraries and the GL driver is not.
+
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0; // Requested bytes of all allocations, freed or not
+
+    AllocationCounts operator-(const AllocationCounts& other) const {
+        return {allocations - other.allocations, frees - other.frees, bytes - other.bytes};
+    }
+};
+
+// Allocations made by the calling thread since it started
+AllocationCounts threadAllocationCounts();
+// Allocations made by every thread since the process started
+AllocationCounts processAllocationCounts();
+
+// Record the call site of every 'interval'-th allocation on each thread; 0 turns sampling off
+void setAllocationSampling(unsigned int interval);
+// Print the sampled call sites, most frequent first. Allocates, so keep it out of measured code
+void printAllocationSamples(std::ostream& out);
+
+// Splits the allocations of one frame into named phases on the calling thread:
+// begin() at the start of the frame, mark("name") at the end of each phase.
+// Fixed-size, so measuring does not allocate itself
+class AllocationPhases {
+    public:
+    static const unsigned int MAX_PHASES = 16;
+
+    void begin();
+    // Attribute everything since the previous mark (or begin) to 'name'. Must be a string literal
+    void mark(const char* name);
+
+    AllocationCounts total() const;
+    // "N allocations, B bytes (phase a/b, ...)", listing only phases that allocated
+    void print(std::ostream& out) const;
+
+    private:
+    const char* names[MAX_PHASES];
+    AllocationCounts counts[MAX_PHASES];
+    unsigned int phaseCount = 0;
+    AllocationCounts last;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <sstream>
+
+#include "autotuner.hpp"
+#include "machine_info.hpp"
+
+// Each trial runs this often and keeps the fastest time, which filters out preemption
+static const unsigned int TRIAL_REPEATS = 3;
+// The direct sum costs the same for every body, so at large N only this many are timed and the
+// time is scaled up. Keeps trials short where the direct sum is hopeless anyway
+static const size_t DIRECT_TRIAL_BODIES = 2048;
+// Bodies the accuracy of approximate solvers is checked on
+static const size_t ERROR_SAMPLE_BODIES = 256;
+// Sampled bodies whose direct-sum reference one advance() computes. Each costs a pass over all
+// bodies, so a slice stays around the cost of one approximate force pass
+static const size_t REFERENCE_SLICE = 16;
+
+static const float THETA_CANDIDATES[] = {0.3f, 0.5f, 0.7f};
+static const unsigned int LEAF_SIZE_CANDIDATES[] = {4, 8, 16, 32};
+static const size_t GRAIN_CANDIDATES[] = {4, 16, 64};
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stored choices are shared by body counts with the same highest bit
+static unsigned int sizeBucket(size_t bodyCount) {
+    unsigned int bucket = 0;
+    while (bodyCount > 0) {
+        bodyCount >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static std::string tunePath() {
+    return std::string(AUTOTUNE_DIR) + "/" + machineFingerprint() + ".txt";
+}
+
+Autotuner::Autotuner(const std::string& scenario, double errorBudget) : scenario(scenario), errorBudget(errorBudget) {}
+
+bool Autotuner::load(size_t bodyCount, SolverConfig& config) const {
+    // One choice per line: scenario, size bucket, solver, theta, leaf size, threads, grain
+    std::ifstream file(tunePath());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name, solver;
+        unsigned int bucket;
+        SolverConfig stored;
+        if (!(fields >> name >> bucket >> solver >> stored.theta >> stored.leafSize >> stored.threads >> stored.grain)) continue;
+        if (name != scenario || bucket != sizeBucket(bodyCount) || !parseSolver(solver.c_str(), stored.solver)) continue;
+        config = stored;
+        return true;
+    }
+    return false;
+}
+
+void Autotuner::save(const AutotuneResult& result) const {
+    std::string path = tunePath();
+    std::vector<std::string> lines;
+    std::ifstream in(path);
+    std::string line;
+    std::string prefix = scenario + " " + std::to_string(sizeBucket(result.bodyCount)) + " ";
+    while (std::getline(in, line)) {
+        if (line.compare(0, prefix.size(), prefix) != 0) lines.push_back(line);
+    }
+    in.close();
+
+    const SolverConfig& config = result.config;
+    std::ostringstream entry;
+    entry << prefix << solverName(config.solver) << " " << config.theta << " " << config.leafSize << " "
+          << config.threads << " " << config.grain;
+    lines.push_back(entry.str());
+
+    mkdir(AUTOTUNE_DIR, 0755);
+    std::ofstream out(path);
+    for (const std::string &stored : lines) out << stored << "\n";
+    if (!out) std::cerr << "Failed to store autotuning results in " << path << "\n";
+}
+
+void printAutotuneResult(std::ostream& out, const AutotuneResult& result) {
+    const SolverConfig& best = result.config;
+    out << "Autotuned " << result.bodyCount << " bodies: " << solverName(best.solver);
+    if (best.solver == ForceSolver::BarnesHut) out << " theta " << best.theta << " leaf " << best.leafSize;
+    out << ", " << (best.threads ? best.threads : result.concurrency) << " threads, grain " << best.grain << ": "
+        << result.seconds * 1e3 << " ms per force pass (direct " << result.directSeconds * 1e3 << " ms)" << std::endl;
+}
+
+void Autotuner::reserve(const std::vector<Sphere>& spheres, BarnesHutTree& tree) {
+    stage = TuneStage::Idle;
+    trialSpheres.reserve(spheres.size());
+    sample.reserve(ERROR_SAMPLE_BODIES);
+    reference.reserve(ERROR_SAMPLE_BODIES);
+    errors.reserve(ERROR_SAMPLE_BODIES);
+    // The smallest leaves make the most nodes
+    trialTree.build(spheres, LEAF_SIZE_CANDIDATES[0]);
+    tree.build(spheres, LEAF_SIZE_CANDIDATES[0]);
+}
+
+void Autotuner::begin(const std::vector<Sphere>& spheres) {
+    trialSpheres = spheres;
+    sample.clear();
+    reference.clear();
+    referenceNext = 0;
+    stage = TuneStage::Reference;
+}
+
+void Autotuner::computeReference(size_t slice) {
+    size_t count = trialSpheres.size();
+    size_t sampleCount = std::min(count, ERROR_SAMPLE_BODIES);
+    size_t end = std::min(sampleCount, referenceNext + slice);
+    for (; referenceNext < end; referenceNext++) {
+        uint32_t i = referenceNext * count / sampleCount;
+        glm::dvec3 acc = referenceAcceleration(trialSpheres, i);
+        // Bodies without any pull cannot have a relative error
+        if (glm::length(acc) == 0.0) continue;
+        sample.push_back(i);
+        reference.push_back(acc);
+    }
+}
+
+double Autotuner::timePass(const SolverConfig& config, WorkerPool& pool) {
+    size_t count = trialSpheres.size();
+    bool direct = config.solver == ForceSolver::Direct;
+    size_t timed = direct ? std::min(count, DIRECT_TRIAL_BODIES) : count;
+
+    double start = now();
+    if (!direct) trialTree.build(trialSpheres, config.leafSize);
+    computeForcesParallel(pool, trialSpheres, timed, config, trialTree);
+    return (now() - start) * count / timed;
+}
+
+bool Autotuner::withinBudget() {
+    errors.clear();
+    for (size_t s = 0; s < sample.size(); s++) {
+        glm::dvec3 acc(trialSpheres[sample[s]].acc);
+        errors.push_back(glm::length(acc - reference[s]) / glm::length(reference[s]));
+    }
+    if (errors.empty()) return true;
+    auto percentile = errors.begin() + (errors.size() - 1) * 99 / 100;
+    std::nth_element(errors.begin(), percentile, errors.end());
+    return *percentile <= errorBudget;
+}
+
+bool Autotuner::candidateAt(unsigned int index, unsigned int concurrency, SolverConfig& candidate) const {
+    candidate = base;
+    switch (stage) {
+    case TuneStage::Direct:
+        // The direct sum on every thread is the baseline everything else has to beat
+        candidate = SolverConfig();
+        return index == 0;
+    case TuneStage::Theta:
+        // Solver and opening angle first: they change the work by orders of magnitude, the rest by a factor
+        if (index >= std::size(THETA_CANDIDATES)) return false;
+        candidate.solver = ForceSolver::BarnesHut;
+        candidate.theta = THETA_CANDIDATES[index];
+        return true;
+    case TuneStage::LeafSize:
+        if (base.solver != ForceSolver::BarnesHut || index >= std::size(LEAF_SIZE_CANDIDATES)) return false;
+        candidate.leafSize = LEAF_SIZE_CANDIDATES[index];
+        return true;
+    case TuneStage::Threads: {
+        // Fewer threads win when the work is too small to pay for waking them
+        unsigned int threads[] = {1, std::max(concurrency / 2, 1u), concurrency};
+        if (index >= std::size(threads)) return false;
+        candidate.threads = threads[index];
+        return true;
+    }
+    case TuneStage::Grain:
+        if (index >= std::size(GRAIN_CANDIDATES)) return false;
+        candidate.grain = GRAIN_CANDIDATES[index];
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Autotuner::advance(WorkerPool& pool, AutotuneResult& result) {
+    if (stage == TuneStage::Idle) return false;
+    if (stage == TuneStage::Reference) {
+        computeReference(REFERENCE_SLICE);
+        if (referenceNext < std::min(trialSpheres.size(), ERROR_SAMPLE_BODIES)) return false;
+        stage = TuneStage::Direct;
+        candidateIndex = 0;
+        repeat = 0;
+        candidateAt(0, pool.concurrency(), candidate);
+        return false;
+    }
+
+    double seconds = timePass(candidate, pool);
+    if (repeat == 0 || seconds < candidateSeconds) candidateSeconds = seconds;
+    if (++repeat < TRIAL_REPEATS) return false;
+    repeat = 0;
+
+    if (stage == TuneStage::Direct) {
+        // Exact by definition
+        best.config = candidate;
+        best.seconds = best.directSeconds = candidateSeconds;
+    } else if (candidateSeconds < best.seconds && (candidate.solver == ForceSolver::Direct || withinBudget())) {
+        best.config = candidate;
+        best.seconds = candidateSeconds;
+    }
+
+    candidateIndex++;
+    while (!candidateAt(candidateIndex, pool.concurrency(), candidate)) {
+        if (stage == TuneStage::Grain) {
+            stage = TuneStage::Idle;
+            best.bodyCount = trialSpheres.size();
+            best.concurrency = pool.concurrency();
+            result = best;
+            return true;
+        }
+        stage = TuneStage(int(stage) + 1);
+        base = best.config;
+        candidateIndex = 0;
+    }
+    return false;
+}
+
+SolverConfig Autotuner::tune(const std::vector<Sphere>& spheres, WorkerPool& pool) {
+    begin(spheres);
+    AutotuneResult result;
+    while (!advance(pool, result)) {}
+    save(result);
+    printAutotuneResult(std::cout, result);
+    return result.config;
+}
@@ -0,0 +1,102 @@
+#ifndef AUTOTUNER_HPP
+#define AUTOTUNER_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "barnes_hut.hpp"
+#include "force_solver.hpp"
+#include "physics.hpp"
+#include "task_graph.hpp"
+
+// Steps between re-tunes while running: one minute of simulated time at 60 Hz
+const uint64_t AUTOTUNE_INTERVAL = 3600;
+// Largest acceptable error of an approximate solver: 99th percentile over sampled bodies of
+// |a - a_direct| / |a_direct|
+const double AUTOTUNE_ERROR_BUDGET = 0.01;
+// Tuned choices, one file per machine fingerprint
+const char* const AUTOTUNE_DIR = "autotune";
+
+// Outcome of one tune
+struct AutotuneResult {
+    SolverConfig config;
+    size_t bodyCount = 0;
+    double seconds = 0.0; // Per force pass with 'config', including the tree build
+    double directSeconds = 0.0; // The same for the direct sum on every thread
+    unsigned int concurrency = 0; // Threads of the pool, for configs that use all of them
+};
+
+// "Autotuned N bodies: ..." on one line
+void printAutotuneResult(std::ostream& out, const AutotuneResult& result);
+
+// Picks the fastest force solver configuration for the current bodies: solver, Barnes-Hut opening
+// angle and leaf size, thread count and grain, one after the other. Every candidate is timed on a
+// copy of the bodies, so trials never disturb the simulation. Approximate candidates whose
+// accelerations miss the direct sum by more than the error budget are rejected.
+// Winners are stored per machine, scenario and body count (by power of two) for the next launch.
+//
+// A tune can also be spread over simulation steps: begin() copies the bodies, then each advance() does
+// one force pass of one candidate, or a slice of the reference sum, so no step stalls for the whole
+// tune. The trials all run on that copy, so stepping goes on undisturbed meanwhile.
+class Autotuner {
+    public:
+    // 'scenario' is a single word naming the kind of scene, e.g. a scenarioName()
+    explicit Autotuner(const std::string& scenario, double errorBudget = AUTOTUNE_ERROR_BUDGET);
+
+    // Choice stored by an earlier tune() on this machine for this scenario and body count
+    bool load(size_t bodyCount, SolverConfig& config) const;
+    // Run the trials and return the winner, which is also stored. Prints a one-line summary.
+    // Safe to call from inside a job of 'pool'
+    SolverConfig tune(const std::vector<Sphere>& spheres, WorkerPool& pool);
+
+    // Size the trial buffers for 'spheres', so that spread tunes of as many bodies do not allocate, and
+    // 'tree' for any leaf size a tune may pick. Drops a spread tune that is still going
+    void reserve(const std::vector<Sphere>& spheres, BarnesHutTree& tree);
+    // Start a spread tune of 'spheres'; restarts one that is still going
+    void begin(const std::vector<Sphere>& spheres);
+    // Next slice of the tune begun last. Returns true, with the winner in 'result', on the slice that
+    // finishes it. Neither stores nor prints. Safe to call from inside a job of 'pool'
+    bool advance(WorkerPool& pool, AutotuneResult& result);
+    bool tuning() const { return stage != TuneStage::Idle; }
+    // Store a winner for the next launch. Does file I/O and allocates; keep it out of steps
+    void save(const AutotuneResult& result) const;
+
+    private:
+    // In the order they run. Each stage starts from the best candidate of the ones before
+    enum class TuneStage { Idle, Reference, Direct, Theta, LeafSize, Threads, Grain };
+
+    // Candidate 'index' of the current stage, or false past its last one
+    bool candidateAt(unsigned int index, unsigned int concurrency, SolverConfig& candidate) const;
+    // Seconds of one force pass of 'config' (including the tree build), scaled to all bodies
+    double timePass(const SolverConfig& config, WorkerPool& pool);
+    // Whether the accelerations of the last pass are within the error budget
+    bool withinBudget();
+    void computeReference(size_t slice);
+
+    std::string scenario;
+    double errorBudget;
+
+    // Progress of the current tune
+    TuneStage stage = TuneStage::Idle;
+    size_t referenceNext = 0; // Next sample slot to compute the reference of
+    unsigned int candidateIndex = 0;
+    unsigned int repeat = 0;
+    SolverConfig base; // Best at the start of the stage
+    SolverConfig candidate;
+    double candidateSeconds = 0.0; // Fastest pass of the candidate so far
+    AutotuneResult best;
+
+    // Reused between tunes, so re-tuning only allocates when the body count grew
+    std::vector<Sphere> trialSpheres;
+    BarnesHutTree trialTree;
+    std::vector<uint32_t> sample; // Bodies the error is measured on
+    std::vector<glm::dvec3> reference; // Their direct-sum accelerations, in double
+    std::vector<double> errors;
+};
+
+#endif
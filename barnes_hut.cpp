@@ -0,0 +1,147 @@
+#include <math.h>
+
+#include "barnes_hut.hpp"
+
+// Each opened cell pushes at most 8 children, one cell per level is open at a time
+static const unsigned int TRAVERSAL_STACK_SIZE = 8 * BARNES_HUT_MAX_DEPTH + 8;
+
+static unsigned int octant(const glm::vec3& pos, const glm::vec3& center) {
+    return (pos.x >= center.x ? 1 : 0) | (pos.y >= center.y ? 2 : 0) | (pos.z >= center.z ? 4 : 0);
+}
+
+void BarnesHutTree::build(const std::vector<Sphere>& spheres, unsigned int leafSize) {
+    nodes.clear();
+    bodies.resize(spheres.size());
+    scratch.resize(spheres.size());
+    if (spheres.empty()) return;
+    if (leafSize == 0) leafSize = 1;
+
+    glm::vec3 low = spheres[0].pos;
+    glm::vec3 high = spheres[0].pos;
+    for (uint32_t i = 0; i < spheres.size(); i++) {
+        bodies[i] = i;
+        low = glm::min(low, spheres[i].pos);
+        high = glm::max(high, spheres[i].pos);
+    }
+    glm::vec3 extent = high - low;
+    float halfSize = 0.5f * fmaxf(extent.x, fmaxf(extent.y, extent.z));
+
+    OctreeNode root = {};
+    root.center = 0.5f * (low + high);
+    // Slightly larger, so bodies on the upper faces are not lost to rounding
+    root.halfSize = halfSize * 1.001f + 1e-6f;
+    root.begin = 0;
+    root.end = spheres.size();
+    nodes.push_back(root);
+    split(spheres, 0, leafSize, 0);
+}
+
+void BarnesHutTree::split(const std::vector<Sphere>& spheres, uint32_t node, unsigned int leafSize, unsigned int depth) {
+    // 'nodes' grows below; work on a copy and store it back at the end
+    OctreeNode cell = nodes[node];
+
+    if (cell.end - cell.begin <= leafSize || depth == BARNES_HUT_MAX_DEPTH) {
+        // Leaf: mass and center of mass straight from its bodies, summed in double
+        double mass = 0.0;
+        glm::dvec3 weighted(0.0);
+        for (uint32_t b = cell.begin; b < cell.end; b++) {
+            const Sphere &sphere = spheres[bodies[b]];
+            mass += sphere.mass;
+            weighted += double(sphere.mass) * glm::dvec3(sphere.pos);
+        }
+        cell.mass = float(mass);
+        cell.centerOfMass = mass > 0.0 ? glm::vec3(weighted / mass) : cell.center;
+        nodes[node] = cell;
+        return;
+    }
+
+    // Counting sort of the node's bodies by octant
+    uint32_t counts[8] = {};
+    for (uint32_t b = cell.begin; b < cell.end; b++) counts[octant(spheres[bodies[b]].pos, cell.center)]++;
+    uint32_t starts[8];
+    uint32_t offset = cell.begin;
+    for (unsigned int o = 0; o < 8; o++) {
+        starts[o] = offset;
+        offset += counts[o];
+    }
+    uint32_t fill[8];
+    for (unsigned int o = 0; o < 8; o++) fill[o] = starts[o];
+    for (uint32_t b = cell.begin; b < cell.end; b++) {
+        uint32_t body = bodies[b];
+        scratch[fill[octant(spheres[body].pos, cell.center)]++] = body;
+    }
+    for (uint32_t b = cell.begin; b < cell.end; b++) bodies[b] = scratch[b];
+
+    // Non-empty octants become children, stored contiguously
+    cell.firstChild = nodes.size();
+    cell.childCount = 0;
+    float childHalf = 0.5f * cell.halfSize;
+    for (unsigned int o = 0; o < 8; o++) {
+        if (counts[o] == 0) continue;
+        OctreeNode child = {};
+        child.center = cell.center + childHalf * glm::vec3(o & 1 ? 1.f : -1.f, o & 2 ? 1.f : -1.f, o & 4 ? 1.f : -1.f);
+        child.halfSize = childHalf;
+        child.begin = starts[o];
+        child.end = starts[o] + counts[o];
+        nodes.push_back(child);
+        cell.childCount++;
+    }
+
+    double mass = 0.0;
+    glm::dvec3 weighted(0.0);
+    for (uint32_t c = cell.firstChild; c < cell.firstChild + cell.childCount; c++) {
+        split(spheres, c, leafSize, depth + 1);
+        mass += nodes[c].mass;
+        weighted += double(nodes[c].mass) * glm::dvec3(nodes[c].centerOfMass);
+    }
+    cell.mass = float(mass);
+    cell.centerOfMass = mass > 0.0 ? glm::vec3(weighted / mass) : cell.center;
+    nodes[node] = cell;
+}
+
+void BarnesHutTree::computeForces(std::vector<Sphere>& spheres, size_t begin, size_t end, float theta) const {
+    if (nodes.empty()) return;
+    float thetaSquared = theta * theta;
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+
+    for (size_t i = begin; i < end; i++) {
+        Sphere &circle = spheres[i];
+        glm::vec3 acc(0.f);
+
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const OctreeNode &cell = nodes[stack[--top]];
+
+            if (cell.firstChild == 0) {
+                // Leaf: exact, with the same terms as computeForces
+                for (uint32_t b = cell.begin; b < cell.end; b++) {
+                    uint32_t j = bodies[b];
+                    if (j == i) continue;
+                    const Sphere &circle2 = spheres[j];
+                    glm::vec3 dr = circle2.pos - circle.pos;
+                    float dist = glm::length(dr);
+                    // Touching spheres are handled by resolveOverlaps
+                    if (dist < circle.radius + circle2.radius) continue;
+                    acc += dr / dist * (G * circle2.mass / (powf(10, 9) * dist * dist));
+                }
+                continue;
+            }
+
+            glm::vec3 dr = cell.centerOfMass - circle.pos;
+            float distSquared = glm::dot(dr, dr);
+            float size = 2.f * cell.halfSize;
+            glm::vec3 inside = glm::abs(circle.pos - cell.center);
+            bool containsBody = inside.x <= cell.halfSize && inside.y <= cell.halfSize && inside.z <= cell.halfSize;
+
+            if (!containsBody && size * size < thetaSquared * distSquared) {
+                // Far enough: the whole cell as one point mass
+                float dist = sqrtf(distSquared);
+                acc += dr / dist * (G * cell.mass / (powf(10, 9) * distSquared));
+            } else {
+                for (uint32_t c = cell.firstChild; c < cell.firstChild + cell.childCount; c++) stack[top++] = c;
+            }
+        }
+        circle.acc = acc;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef BARNES_HUT_HPP
+#define BARNES_HUT_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "physics.hpp"
+
+// Deepest octree level. Bodies at (nearly) the same position cannot be split apart; past this
+// depth they simply share one leaf
+const unsigned int BARNES_HUT_MAX_DEPTH = 32;
+
+// Cube of space in the octree
+struct OctreeNode {
+    glm::vec3 centerOfMass;
+    float mass;
+    glm::vec3 center; // Of the cube
+    float halfSize;
+    uint32_t firstChild; // Children are stored next to each other. 0 for leaves: the root is nobody's child
+    uint32_t childCount;
+    uint32_t begin; // Bodies of the node, as a range of BarnesHutTree::bodies
+    uint32_t end;
+};
+
+// Barnes-Hut gravity: bodies are sorted into an octree, and a cell far enough away from a body
+// acts on it as one point mass at its center of mass. O(N log N) instead of the O(N^2) direct sum.
+// The tree is rebuilt every step; the buffers keep their capacity, so steady-state builds do not allocate
+class BarnesHutTree {
+    public:
+    // Leaves hold up to 'leafSize' bodies, which interact directly with bodies that open them
+    void build(const std::vector<Sphere>& spheres, unsigned int leafSize);
+
+    // Same as computeForces(spheres, begin, end), approximated: a cell whose size seen from a body is
+    // below 'theta' (radians, roughly) is not opened. theta = 0 is the direct sum. Only writes
+    // acc of [begin, end), so ranges can run in parallel
+    void computeForces(std::vector<Sphere>& spheres, size_t begin, size_t end, float theta) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    private:
+    void split(const std::vector<Sphere>& spheres, uint32_t node, unsigned int leafSize, unsigned int depth);
+
+    std::vector<OctreeNode> nodes;
+    std::vector<uint32_t> bodies; // Sphere indices, grouped by node
+    std::vector<uint32_t> scratch; // Partitioning buffer, same size as 'bodies'
+};
+
+#endif
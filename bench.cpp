@@ -0,0 +1,299 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <benchmark/benchmark.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "barnes_hut.hpp"
+#include "bench_gate.hpp"
+#include "force_solver.hpp"
+#include "machine_info.hpp"
+#include "physics.hpp"
+#include "setup.hpp"
+#include "shader_program.hpp"
+#include "sphere_mesh.hpp"
+
+// Microbenchmarks for the hot paths. Built and run by 'make bench', which writes bench_results.json.
+// Filter with --benchmark_filter=<regex>; compare runs with Google Benchmark's compare.py
+
+// Pair interactions per iteration of the force benchmark. Rows of the N x N pair loop are
+// sampled so large N still finish; the rate per pair is what gets compared
+static const double FORCE_PAIRS_PER_ITERATION = 1e7;
+
+// Bodies spread through the unit cube, well inside the walls and apart, like a typical scene
+static std::vector<Sphere> makeSpheres(size_t count, bool atWalls = false) {
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> coordinate(-0.9f, 0.9f);
+    std::uniform_real_distribution<float> speed(-1e-3f, 1e-3f);
+    std::vector<Sphere> spheres;
+    spheres.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 pos(coordinate(random), coordinate(random), coordinate(random));
+        // Touching a wall on every axis, so every bounce branch in updatePos is taken
+        if (atWalls) pos = glm::vec3(i % 2 ? 0.995f : -0.995f, i % 3 ? 0.995f : -0.995f, i % 5 ? 0.995f : -0.995f);
+        spheres.emplace_back(pos, glm::vec3(speed(random), speed(random), speed(random)), 0.01f, 7.35E17);
+        // Pushed into the wall, so the damped bounce settles on a steady speed instead of decaying
+        // into denormals, which would measure the FPU's slow path instead of the collision code
+        if (atWalls) spheres.back().acc = pos;
+    }
+    return spheres;
+}
+
+static void BM_PairForces(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0));
+    size_t rows = FORCE_PAIRS_PER_ITERATION / spheres.size();
+    if (rows < 1) rows = 1;
+    if (rows > spheres.size()) rows = spheres.size();
+
+    for (auto _ : state) {
+        computeForces(spheres, 0, rows);
+        benchmark::DoNotOptimize(spheres[0].acc);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * (spheres.size() - 1));
+    state.counters["rows"] = rows;
+}
+BENCHMARK(BM_PairForces)->RangeMultiplier(10)->Range(10, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Tree build plus an approximate force pass over every body, at the default opening angle
+static void BM_BarnesHutForces(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0));
+    BarnesHutTree tree;
+    SolverConfig config;
+    for (auto _ : state) {
+        tree.build(spheres, config.leafSize);
+        tree.computeForces(spheres, 0, spheres.size(), config.theta);
+        benchmark::DoNotOptimize(spheres[0].acc);
+    }
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_BarnesHutForces)->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+// The whole step as the frame loop ran it: broadphase, overlap resolution, all N^2 pairs, integration
+static void BM_StepSpheres(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0));
+    for (auto _ : state) {
+        stepSpheres(spheres, 1.f / 60.f);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * spheres.size() * (spheres.size() - 1));
+}
+BENCHMARK(BM_StepSpheres)->RangeMultiplier(10)->Range(10, 10000)->Unit(benchmark::kMicrosecond);
+
+static void BM_UpdatePos(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0));
+    for (auto _ : state) {
+        integrateSpheres(spheres, 0, spheres.size(), 1e-6f);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_UpdatePos)->RangeMultiplier(10)->Range(10, 1000000);
+
+// updatePos with every body bouncing off a wall on all three axes
+static void BM_WallCollisions(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0), true);
+    for (auto _ : state) {
+        integrateSpheres(spheres, 0, spheres.size(), 1e-6f);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_WallCollisions)->RangeMultiplier(10)->Range(10, 1000000);
+
+// Bodies pre-sorted along x, as the sweep sees them after the first step. The insertion sort is
+// meant for that coherent order; a random start is quadratic. Dense scenes make the sweep itself
+// quadratic too, so N stops at 10^5
+static void BM_Broadphase(benchmark::State& state) {
+    std::vector<Sphere> spheres = makeSpheres(state.range(0));
+    std::sort(spheres.begin(), spheres.end(), [](const Sphere& a, const Sphere& b) { return a.pos.x < b.pos.x; });
+    std::vector<uint32_t> order;
+    std::vector<SpherePair> pairs;
+    for (auto _ : state) {
+        findOverlappingPairs(spheres, order, pairs);
+        benchmark::DoNotOptimize(pairs.data());
+    }
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_Broadphase)->RangeMultiplier(10)->Range(10, 100000);
+
+// Mesh generation at runtime; the argument is the stack count, with twice as many sectors
+static void BM_SphereVertices(benchmark::State& state) {
+    unsigned int stacks = state.range(0);
+    for (auto _ : state) {
+        std::vector<float> vertices = generateSphereVertices(stacks, 2 * stacks);
+        benchmark::DoNotOptimize(vertices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * sphereVertexCount(stacks, 2 * stacks));
+}
+BENCHMARK(BM_SphereVertices)->RangeMultiplier(2)->Range(8, 128);
+
+static void BM_SphereIndices(benchmark::State& state) {
+    unsigned int stacks = state.range(0);
+    for (auto _ : state) {
+        std::vector<uint16_t> indices;
+        std::vector<uint16_t> lineIndices;
+        generateSphereIndices(stacks, 2 * stacks, indices, lineIndices);
+        benchmark::DoNotOptimize(indices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * sphereIndexCount(stacks, 2 * stacks) / 3);
+}
+BENCHMARK(BM_SphereIndices)->RangeMultiplier(2)->Range(8, 128);
+
+static void BM_VertexCacheOptimize(benchmark::State& state) {
+    unsigned int stacks = state.range(0);
+    std::vector<uint16_t> indices;
+    std::vector<uint16_t> lineIndices;
+    generateSphereIndices(stacks, 2 * stacks, indices, lineIndices);
+    for (auto _ : state) {
+        std::vector<uint16_t> optimized = optimizeVertexCache(indices, sphereVertexCount(stacks, 2 * stacks));
+        benchmark::DoNotOptimize(optimized.data());
+    }
+    state.SetItemsProcessed(state.iterations() * indices.size() / 3);
+}
+BENCHMARK(BM_VertexCacheOptimize)->RangeMultiplier(2)->Range(8, 128);
+
+// Hidden window for the shader benchmarks, created on first use
+static GLFWwindow* benchWindow = nullptr;
+
+static bool initGL(benchmark::State& state) {
+    if (benchWindow) return true;
+    if (!glfwInit()) {
+        state.SkipWithError("GLFW initialization failed (no display?)");
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    benchWindow = glfwCreateWindow(64, 64, "bench", nullptr, nullptr);
+    if (!benchWindow) {
+        state.SkipWithError("Failed to create an OpenGL 4.6 context");
+        return false;
+    }
+    glfwMakeContextCurrent(benchWindow);
+    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    return true;
+}
+
+// Compile and link from source, as on a cache miss
+static void BM_ShaderCompile(benchmark::State& state) {
+    if (!initGL(state)) return;
+    for (auto _ : state) {
+        int program = createShaderProgram("vertex_shader.glsl", "fragment_shader.glsl");
+        glDeleteProgram(program);
+    }
+}
+BENCHMARK(BM_ShaderCompile)->Unit(benchmark::kMillisecond);
+
+// Load from the on-disk program binary cache, as on every launch after the first
+static void BM_ShaderCacheLoad(benchmark::State& state) {
+    if (!initGL(state)) return;
+    ShaderProgram warm;
+    warm.create("vertex_shader.glsl", "fragment_shader.glsl");
+    warm.destroy();
+    for (auto _ : state) {
+        ShaderProgram program;
+        program.create("vertex_shader.glsl", "fragment_shader.glsl");
+        program.destroy();
+    }
+}
+BENCHMARK(BM_ShaderCacheLoad)->Unit(benchmark::kMillisecond);
+
+// Gate mode: enough repetitions for a rank test, interleaved so slow drift in machine state
+// spreads over every benchmark instead of hitting a few
+static const char* const GATE_REPETITIONS = "--benchmark_repetitions=10";
+static const char* const GATE_INTERLEAVING = "--benchmark_enable_random_interleaving=true";
+static const char* const GATE_DISPLAY = "--benchmark_display_aggregates_only=true";
+static const char* const DEFAULT_OUTPUT = "bench_results.json";
+
+static bool hasPrefix(const char* text, const char* prefix) {
+    return std::strncmp(text, prefix, std::strlen(prefix)) == 0;
+}
+
+static bool copyFile(const char* from, const char* to) {
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary);
+    out << in.rdbuf();
+    return in && out;
+}
+
+// Besides the Google Benchmark flags:
+//   --gate                 compare this run against the machine's baseline, exit 1 on a regression
+//   --gate-update          store this run as the machine's baseline
+//   --gate-threshold=<%>   slowdown of the median that counts as a regression, default 5
+int main(int argc, char** argv) {
+    bool gate = false;
+    bool updateBaseline = false;
+    GateThresholds thresholds;
+    std::string outputPath = DEFAULT_OUTPUT;
+    bool hasRepetitions = false;
+    bool hasOutput = false;
+
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (std::strcmp(argv[i], "--gate") == 0) gate = true;
+        else if (std::strcmp(argv[i], "--gate-update") == 0) updateBaseline = true;
+        else if (hasPrefix(argv[i], "--gate-threshold=")) thresholds.slowdown = std::atof(argv[i] + 17) / 100.0;
+        else {
+            if (hasPrefix(argv[i], "--benchmark_repetitions=")) hasRepetitions = true;
+            if (hasPrefix(argv[i], "--benchmark_out=")) {
+                hasOutput = true;
+                outputPath = argv[i] + 16;
+            }
+            args.push_back(argv[i]);
+        }
+    }
+    std::string outputFlag = "--benchmark_out=" + outputPath;
+    std::string formatFlag = "--benchmark_out_format=json";
+    if (gate || updateBaseline) {
+        if (!hasRepetitions) args.push_back(const_cast<char*>(GATE_REPETITIONS));
+        if (!hasOutput) args.push_back(outputFlag.data());
+        args.push_back(formatFlag.data());
+        args.push_back(const_cast<char*>(GATE_INTERLEAVING));
+        args.push_back(const_cast<char*>(GATE_DISPLAY));
+    }
+    int argCount = args.size();
+
+    benchmark::Initialize(&argCount, args.data());
+    if (benchmark::ReportUnrecognizedArguments(argCount, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    if (benchWindow) {
+        glfwDestroyWindow(benchWindow);
+        glfwTerminate();
+    }
+    if (!gate && !updateBaseline) return 0;
+
+    std::vector<BenchmarkSamples> current;
+    if (!readBenchmarkSamples(outputPath.c_str(), current)) return 1;
+    std::string fingerprint = machineFingerprint();
+    std::string baseline = baselinePath(fingerprint);
+
+    if (updateBaseline) {
+        mkdir(BENCH_BASELINE_DIR, 0755);
+        if (!copyFile(outputPath.c_str(), baseline.c_str())) {
+            std::cerr << "Failed to write baseline " << baseline << "\n";
+            return 1;
+        }
+        std::cout << "Stored " << current.size() << " benchmarks as the baseline for " << fingerprint << "\n";
+        return 0;
+    }
+
+    std::vector<BenchmarkSamples> before;
+    if (!readBenchmarkSamples(baseline.c_str(), before)) {
+        std::cerr << "No baseline for this machine (" << fingerprint << "); record one with 'make bench-baseline'\n";
+        return 1;
+    }
+    std::cout << "\nCompared with " << baseline << ":\n";
+    return compareBenchmarks(before, current, thresholds, std::cout) ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "bench_gate.hpp"
+
+// Reads just enough JSON for Google Benchmark's output: the 'benchmarks' array of flat objects.
+// Scalars are kept as their source text, nested values are skipped
+struct JsonReader {
+    const char* at;
+    const char* end;
+
+    void skipSpace() {
+        while (at < end && (*at == ' ' || *at == '\n' || *at == '\r' || *at == '\t')) at++;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (at == end || *at != c) return false;
+        at++;
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (!consume('"')) return false;
+        out.clear();
+        while (at < end && *at != '"') {
+            // Escapes only occur in names we never look up by content; keep the escaped character
+            if (*at == '\\' && at + 1 < end) at++;
+            out += *at++;
+        }
+        return consume('"');
+    }
+
+    // Number, true, false or null, as written
+    bool scalar(std::string& out) {
+        skipSpace();
+        const char* start = at;
+        while (at < end && *at != ',' && *at != '}' && *at != ']' && *at != ' ' && *at != '\n') at++;
+        out.assign(start, at);
+        return at > start;
+    }
+
+    bool skipValue() {
+        skipSpace();
+        if (at == end) return false;
+        std::string ignored;
+        if (*at == '"') return string(ignored);
+        if (*at != '{' && *at != '[') return scalar(ignored);
+
+        char close = *at == '{' ? '}' : ']';
+        at++;
+        if (consume(close)) return true;
+        do {
+            if (close == '}' && (!string(ignored) || !consume(':'))) return false;
+            if (!skipValue()) return false;
+        } while (consume(','));
+        return consume(close);
+    }
+
+    bool flatObject(std::map<std::string, std::string>& fields) {
+        fields.clear();
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        do {
+            std::string key;
+            if (!string(key) || !consume(':')) return false;
+            skipSpace();
+            if (at < end && *at == '"') {
+                if (!string(fields[key])) return false;
+            } else if (at < end && (*at == '{' || *at == '[')) {
+                if (!skipValue()) return false;
+            } else if (!scalar(fields[key])) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+};
+
+static double unitToNanoseconds(const std::string& unit) {
+    if (unit == "us") return 1e3;
+    if (unit == "ms") return 1e6;
+    if (unit == "s") return 1e9;
+    return 1.0;
+}
+
+// The 'benchmarks' array: one entry per repetition of every benchmark, plus aggregates
+static bool readBenchmarkArray(JsonReader& reader, std::vector<BenchmarkSamples>& samples) {
+    if (!reader.consume('[')) return false;
+    if (reader.consume(']')) return true;
+
+    std::map<std::string, size_t> indexByName;
+    std::map<std::string, std::string> fields;
+    do {
+        if (!reader.flatObject(fields)) return false;
+        if (fields["run_type"] == "aggregate" || fields["error_occurred"] == "true") continue;
+        const std::string &name = fields.count("run_name") ? fields["run_name"] : fields["name"];
+        if (name.empty() || fields["real_time"].empty()) continue;
+
+        auto inserted = indexByName.emplace(name, samples.size());
+        if (inserted.second) samples.push_back({name, {}});
+        double time = std::atof(fields["real_time"].c_str()) * unitToNanoseconds(fields["time_unit"]);
+        samples[inserted.first->second].nanoseconds.push_back(time);
+    } while (reader.consume(','));
+    return reader.consume(']');
+}
+
+bool readBenchmarkSamples(const char* path, std::vector<BenchmarkSamples>& samples) {
+    samples.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to read benchmark results " << path << "\n";
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    JsonReader reader{text.data(), text.data() + text.size()};
+    bool found = false;
+    bool ok = reader.consume('{');
+    if (ok && !reader.consume('}')) {
+        do {
+            std::string key;
+            ok = reader.string(key) && reader.consume(':');
+            if (ok && key == "benchmarks") {
+                found = true;
+                ok = readBenchmarkArray(reader, samples);
+            } else if (ok) {
+                ok = reader.skipValue();
+            }
+        } while (ok && reader.consume(','));
+        ok = ok && reader.consume('}');
+    }
+    if (!ok || !found) {
+        std::cerr << "Malformed benchmark results " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+std::string baselinePath(const std::string& fingerprint) {
+    return std::string(BENCH_BASELINE_DIR) + "/" + fingerprint + ".json";
+}
+
+double mannWhitneyPValue(const std::vector<double>& baseline, const std::vector<double>& current) {
+    size_t n1 = baseline.size();
+    size_t n2 = current.size();
+    if (n1 == 0 || n2 == 0) return 1.0;
+
+    // Rank the pooled sample, ties getting their average rank
+    std::vector<std::pair<double, bool>> pooled; // Value, from 'current'
+    for (double value : baseline) pooled.push_back({value, false});
+    for (double value : current) pooled.push_back({value, true});
+    std::sort(pooled.begin(), pooled.end());
+
+    double currentRanks = 0.0;
+    double tieCorrection = 0.0;
+    for (size_t i = 0; i < pooled.size();) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) j++;
+        double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++) {
+            if (pooled[k].second) currentRanks += rank;
+        }
+        double ties = j - i;
+        tieCorrection += ties * ties * ties - ties;
+        i = j;
+    }
+
+    // U counts pairs where the current run was slower; normal approximation with continuity correction
+    double u = currentRanks - n2 * (n2 + 1) / 2.0;
+    double n = n1 + n2;
+    double mean = n1 * n2 / 2.0;
+    double variance = n1 * n2 / 12.0 * ((n + 1) - tieCorrection / (n * (n - 1)));
+    if (variance <= 0.0) return u > mean ? 0.0 : 1.0;
+    double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+bool compareBenchmarks(const std::vector<BenchmarkSamples>& baseline, const std::vector<BenchmarkSamples>& current,
+                       const GateThresholds& thresholds, std::ostream& report) {
+    std::map<std::string, const BenchmarkSamples*> baselineByName;
+    for (const BenchmarkSamples &samples : baseline) baselineByName[samples.name] = &samples;
+
+    size_t nameWidth = 9;
+    for (const BenchmarkSamples &samples : current) nameWidth = std::max(nameWidth, samples.name.size());
+
+    char line[512];
+    std::snprintf(line, sizeof(line), "%-*s %12s %12s %8s %8s  %s\n", int(nameWidth), "benchmark", "baseline ns",
+                  "current ns", "change", "p", "verdict");
+    report << line;
+
+    // Interleaved runs come out shuffled; sorted by name, sizes of one benchmark end up together
+    std::vector<const BenchmarkSamples*> sorted;
+    for (const BenchmarkSamples &samples : current) sorted.push_back(&samples);
+    std::sort(sorted.begin(), sorted.end(), [](const BenchmarkSamples* a, const BenchmarkSamples* b) { return a->name < b->name; });
+
+    unsigned int regressions = 0;
+    unsigned int compared = 0;
+    for (const BenchmarkSamples* entry : sorted) {
+        const BenchmarkSamples &samples = *entry;
+        auto found = baselineByName.find(samples.name);
+        if (found == baselineByName.end()) {
+            std::snprintf(line, sizeof(line), "%-*s %12s %12.1f %8s %8s  new, no baseline\n", int(nameWidth),
+                          samples.name.c_str(), "-", median(samples.nanoseconds), "-", "-");
+            report << line;
+            continue;
+        }
+        const std::vector<double> &before = found->second->nanoseconds;
+        double baselineMedian = median(before);
+        double currentMedian = median(samples.nanoseconds);
+        double change = currentMedian / baselineMedian - 1.0;
+        double p = mannWhitneyPValue(before, samples.nanoseconds);
+
+        const char* verdict = "ok";
+        if (change > thresholds.slowdown) {
+            if (p < thresholds.significance) {
+                verdict = "REGRESSION";
+                regressions++;
+            } else {
+                verdict = "slower, within noise";
+            }
+        } else if (change < -thresholds.slowdown && mannWhitneyPValue(samples.nanoseconds, before) < thresholds.significance) {
+            verdict = "faster";
+        }
+        std::snprintf(line, sizeof(line), "%-*s %12.1f %12.1f %+7.1f%% %8.4f  %s\n", int(nameWidth), samples.name.c_str(),
+                      baselineMedian, currentMedian, 100.0 * change, p, verdict);
+        report << line;
+        compared++;
+    }
+
+    if (compared == 0) {
+        report << "No benchmark of this run has a baseline\n";
+        return false;
+    }
+    if (regressions > 0) {
+        report << regressions << " of " << compared << " benchmarks regressed by more than " << 100.0 * thresholds.slowdown
+               << "% (p < " << thresholds.significance << ")\n";
+        return false;
+    }
+    report << "No regressions in " << compared << " benchmarks\n";
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef BENCH_GATE_HPP
+#define BENCH_GATE_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Benchmark regression gate: compares a run of the benchmark suite against a stored baseline
+// from the same machine and fails when a benchmark got slower by more than noise explains.
+// Both sides are Google Benchmark JSON files recorded with --benchmark_repetitions, so every
+// benchmark has a sample of timings, compared with a one-sided Mann-Whitney U test.
+
+// Directory of baseline files, one per machine fingerprint
+const char* const BENCH_BASELINE_DIR = "bench_baselines";
+
+// Per-iteration wall time of every repetition of one benchmark
+struct BenchmarkSamples {
+    std::string name;
+    std::vector<double> nanoseconds;
+};
+
+struct GateThresholds {
+    double slowdown = 0.05; // Fraction the median may grow by before it counts
+    double significance = 0.05; // One-sided p-value below which a slowdown is not noise
+};
+
+// Baseline file for a machineFingerprint()
+std::string baselinePath(const std::string& fingerprint);
+
+// Iteration runs of a Google Benchmark JSON file, grouped by benchmark. Aggregates and errored runs
+// are left out. Prints to stderr and returns false if the file is missing or malformed
+bool readBenchmarkSamples(const char* path, std::vector<BenchmarkSamples>& samples);
+
+// Probability of 'current' being at least this much slower than 'baseline' by chance alone
+double mannWhitneyPValue(const std::vector<double>& baseline, const std::vector<double>& current);
+
+// Writes a table of every benchmark present in both runs. Returns false if any regressed
+bool compareBenchmarks(const std::vector<BenchmarkSamples>& baseline, const std::vector<BenchmarkSamples>& current,
+                       const GateThresholds& thresholds, std::ostream& report);
+
+#endif
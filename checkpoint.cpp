@@ -0,0 +1,285 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "checkpoint.hpp"
+
+// Arrays are written straight from memory
+static_assert(std::endian::native == std::endian::little, "checkpoints are little-endian");
+
+struct CheckpointHeader {
+    char magic[8]; // "GRAVCKPT"
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t bodyCount;
+    uint64_t step;
+    double simTime;
+    float dt;
+    uint32_t seed;
+    uint64_t fileSize; // Of the whole file, catches truncated copies
+    uint64_t reserved;
+};
+static_assert(sizeof(CheckpointHeader) == CHECKPOINT_ALIGNMENT, "the header fills one aligned block");
+
+enum CheckpointField : uint32_t {
+    FIELD_POSITION = 1,
+    FIELD_VELOCITY,
+    FIELD_ACCELERATION,
+    FIELD_RADIUS,
+    FIELD_MASS,
+    FIELD_COLOR,
+    FIELD_SWEEP_ORDER,
+};
+
+struct CheckpointSection {
+    uint32_t field; // CheckpointField
+    uint32_t elementSize; // Bytes per element, checked on reading
+    uint64_t count; // Elements; the body count, or 0 for a sweep order that was never computed
+    uint64_t offset; // From the start of the file, a multiple of CHECKPOINT_ALIGNMENT
+    uint64_t reserved;
+};
+
+static const CheckpointField FIELDS[] = {FIELD_POSITION, FIELD_VELOCITY, FIELD_ACCELERATION, FIELD_RADIUS,
+                                         FIELD_MASS, FIELD_COLOR, FIELD_SWEEP_ORDER};
+static const uint32_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+static uint32_t elementSize(CheckpointField field) {
+    switch (field) {
+        case FIELD_RADIUS:
+        case FIELD_MASS:
+        case FIELD_SWEEP_ORDER: return 4;
+        default: return sizeof(glm::vec3);
+    }
+}
+
+static glm::vec3 Sphere::*vectorMember(CheckpointField field) {
+    switch (field) {
+        case FIELD_POSITION: return &Sphere::pos;
+        case FIELD_VELOCITY: return &Sphere::vel;
+        case FIELD_ACCELERATION: return &Sphere::acc;
+        default: return &Sphere::color;
+    }
+}
+
+// One field of every body, packed into 'out'
+static void gatherField(unsigned char* out, const std::vector<Sphere>& spheres, const std::vector<uint32_t>& sweepOrder,
+                        CheckpointField field) {
+    if (field == FIELD_SWEEP_ORDER) {
+        std::memcpy(out, sweepOrder.data(), sweepOrder.size() * sizeof(uint32_t));
+    } else if (field == FIELD_RADIUS || field == FIELD_MASS) {
+        float Sphere::*member = field == FIELD_RADIUS ? &Sphere::radius : &Sphere::mass;
+        for (const Sphere &sphere : spheres) {
+            std::memcpy(out, &(sphere.*member), sizeof(float));
+            out += sizeof(float);
+        }
+    } else {
+        glm::vec3 Sphere::*member = vectorMember(field);
+        for (const Sphere &sphere : spheres) {
+            std::memcpy(out, &(sphere.*member), sizeof(glm::vec3));
+            out += sizeof(glm::vec3);
+        }
+    }
+}
+
+// Where each array goes; returns the file size
+static uint64_t layoutSections(uint64_t bodyCount, uint64_t sweepOrderSize, CheckpointSection (&sections)[FIELD_COUNT]) {
+    uint64_t offset = alignUp(sizeof(CheckpointHeader) + sizeof(sections));
+    for (uint32_t s = 0; s < FIELD_COUNT; s++) {
+        sections[s].field = FIELDS[s];
+        sections[s].elementSize = elementSize(FIELDS[s]);
+        sections[s].count = FIELDS[s] == FIELD_SWEEP_ORDER ? sweepOrderSize : bodyCount;
+        sections[s].offset = offset;
+        offset = alignUp(offset + sections[s].count * sections[s].elementSize);
+    }
+    return offset;
+}
+
+uint64_t checkpointSize(uint64_t bodyCount) {
+    CheckpointSection sections[FIELD_COUNT];
+    return layoutSections(bodyCount, bodyCount, sections);
+}
+
+bool buildCheckpointImage(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& sweepOrder,
+                          const SimulationClock& clock, std::vector<unsigned char>& image) {
+    uint64_t bodyCount = spheres.size();
+    if (!sweepOrder.empty() && sweepOrder.size() != bodyCount) {
+        std::cerr << "Checkpoint: sweep order does not match the bodies\n";
+        return false;
+    }
+
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, "GRAVCKPT", 8);
+    header.version = CHECKPOINT_VERSION;
+    header.sectionCount = FIELD_COUNT;
+    header.bodyCount = bodyCount;
+    header.step = clock.step;
+    header.simTime = clock.simTime;
+    header.dt = clock.dt;
+    header.seed = clock.seed;
+
+    CheckpointSection sections[FIELD_COUNT] = {};
+    header.fileSize = layoutSections(bodyCount, sweepOrder.size(), sections);
+
+    try {
+        image.resize(header.fileSize);
+    } catch (const std::bad_alloc&) {
+        std::cerr << "Checkpoint: cannot allocate " << header.fileSize << " bytes\n";
+        return false;
+    }
+    // Only the padding between arrays is zeroed, the arrays are written over
+    std::memcpy(image.data(), &header, sizeof(header));
+    std::memcpy(image.data() + sizeof(header), sections, sizeof(sections));
+    uint64_t written = sizeof(header) + sizeof(sections);
+    for (const CheckpointSection &section : sections) {
+        std::memset(image.data() + written, 0, section.offset - written);
+        gatherField(image.data() + section.offset, spheres, sweepOrder, CheckpointField(section.field));
+        written = section.offset + section.count * section.elementSize;
+    }
+    std::memset(image.data() + written, 0, header.fileSize - written);
+    return true;
+}
+
+bool writeCheckpoint(const char* path, const std::vector<Sphere>& spheres, const std::vector<uint32_t>& sweepOrder,
+                     const SimulationClock& clock) {
+    std::vector<unsigned char> image;
+    if (!buildCheckpointImage(spheres, sweepOrder, clock, image)) return false;
+    return writeCheckpointImage(path, (std::string(path) + ".tmp").c_str(), image);
+}
+
+bool writeCheckpointImage(const char* path, const char* tempPath, const std::vector<unsigned char>& image) {
+    uint64_t fileSize = image.size();
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Checkpoint " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    // One pwrite for the whole image; Linux caps a single call at about 2 GB, so larger ones continue
+    uint64_t done = 0;
+    while (done < fileSize) {
+        ssize_t result = pwrite(fd, image.data() + done, fileSize - done, done);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) break;
+        done += result;
+    }
+    // Durable before it replaces the previous checkpoint
+    bool complete = done == fileSize && fsync(fd) == 0;
+    complete = close(fd) == 0 && complete;
+    if (!complete || rename(tempPath, path) != 0) {
+        std::cerr << "Checkpoint " << path << ": write failed: " << std::strerror(errno) << "\n";
+        remove(tempPath);
+        return false;
+    }
+    return true;
+}
+
+bool readCheckpoint(const char* path, SimulationState& state) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Checkpoint " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(CheckpointHeader)) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file open by itself
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Checkpoint " << path << ": cannot map the file\n";
+        return false;
+    }
+    const unsigned char* file = static_cast<const unsigned char*>(mapping);
+    uint64_t fileSize = info.st_size;
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    CheckpointHeader header;
+    std::memcpy(&header, file, sizeof(header));
+    const char* error = nullptr;
+    if (std::memcmp(header.magic, "GRAVCKPT", 8) != 0) error = "not a checkpoint";
+    else if (header.version != CHECKPOINT_VERSION) error = "unsupported version";
+    else if (header.fileSize != fileSize) error = "truncated";
+    else if (sizeof(header) + uint64_t(header.sectionCount) * sizeof(CheckpointSection) > fileSize) error = "truncated";
+
+    // Every field this version knows must be present, sized and inside the file
+    const CheckpointSection* found[FIELD_COUNT] = {};
+    for (uint32_t s = 0; !error && s < header.sectionCount; s++) {
+        const CheckpointSection* section = reinterpret_cast<const CheckpointSection*>(file + sizeof(header)) + s;
+        for (uint32_t f = 0; f < FIELD_COUNT; f++) {
+            if (section->field == FIELDS[f]) found[f] = section;
+        }
+    }
+    for (uint32_t f = 0; !error && f < FIELD_COUNT; f++) {
+        const CheckpointSection* section = found[f];
+        bool optional = FIELDS[f] == FIELD_SWEEP_ORDER;
+        if (!section || section->elementSize != elementSize(FIELDS[f]) || section->offset % CHECKPOINT_ALIGNMENT != 0 ||
+            (section->count != header.bodyCount && !(optional && section->count == 0)) ||
+            // Divided, not multiplied: a damaged count must not wrap past the check. This also bounds
+            // the body count by the file size before anything is allocated for it
+            section->offset > fileSize || section->count > (fileSize - section->offset) / section->elementSize) {
+            error = "damaged section table";
+        }
+    }
+    if (error) {
+        std::cerr << "Checkpoint " << path << ": " << error << "\n";
+        munmap(mapping, fileSize);
+        return false;
+    }
+
+    auto column = [&](CheckpointField field) {
+        for (uint32_t f = 0; f < FIELD_COUNT; f++) {
+            if (FIELDS[f] == field) return file + found[f]->offset;
+        }
+        return file;
+    };
+    const unsigned char* positions = column(FIELD_POSITION);
+    const unsigned char* velocities = column(FIELD_VELOCITY);
+    const unsigned char* accelerations = column(FIELD_ACCELERATION);
+    const unsigned char* radii = column(FIELD_RADIUS);
+    const unsigned char* masses = column(FIELD_MASS);
+    const unsigned char* colors = column(FIELD_COLOR);
+
+    state.spheres.clear();
+    state.spheres.reserve(header.bodyCount);
+    for (uint64_t i = 0; i < header.bodyCount; i++) {
+        glm::vec3 pos, vel, acc, color;
+        float radius, mass;
+        std::memcpy(&pos, positions + i * sizeof(glm::vec3), sizeof(glm::vec3));
+        std::memcpy(&vel, velocities + i * sizeof(glm::vec3), sizeof(glm::vec3));
+        std::memcpy(&acc, accelerations + i * sizeof(glm::vec3), sizeof(glm::vec3));
+        std::memcpy(&color, colors + i * sizeof(glm::vec3), sizeof(glm::vec3));
+        std::memcpy(&radius, radii + i * sizeof(float), sizeof(float));
+        std::memcpy(&mass, masses + i * sizeof(float), sizeof(float));
+        state.spheres.emplace_back(pos, vel, radius, mass, color);
+        state.spheres.back().acc = acc;
+    }
+    state.sweepOrder.resize(found[FIELD_COUNT - 1]->count);
+    std::memcpy(state.sweepOrder.data(), column(FIELD_SWEEP_ORDER), state.sweepOrder.size() * sizeof(uint32_t));
+    munmap(mapping, fileSize);
+    // The broadphase indexes bodies with it
+    for (uint32_t index : state.sweepOrder) {
+        if (index >= header.bodyCount) {
+            std::cerr << "Checkpoint " << path << ": damaged sweep order\n";
+            return false;
+        }
+    }
+
+    state.clock.step = header.step;
+    state.clock.simTime = header.simTime;
+    state.clock.dt = header.dt;
+    state.clock.seed = header.seed;
+    return true;
+}
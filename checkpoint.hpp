@@ -0,0 +1,55 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "physics.hpp"
+
+// Binary checkpoint of a run, for restarting where it stopped. Little-endian, versioned:
+//
+//   CheckpointHeader               64 bytes
+//   CheckpointSection[count]       where each body array is, padded to 64 bytes
+//   arrays                         one per field (positions, velocities, ...), each 64-byte aligned
+//
+// Arrays are plain memory images, so a restart maps the file and copies them out without parsing.
+// The file is built in memory and written with pwrite to a temporary name, then renamed over the
+// previous checkpoint: a run killed while writing keeps its last complete one
+
+const uint32_t CHECKPOINT_VERSION = 1;
+const uint64_t CHECKPOINT_ALIGNMENT = 64;
+
+// Where a run is in time
+struct SimulationClock {
+    uint64_t step = 0;
+    double simTime = 0.0; // Seconds
+    float dt = 0.f; // Step length the run was made with
+    // Seed the initial state was generated from, 0 if it was not. Stepping draws no random numbers,
+    // so this is the whole RNG state
+    uint32_t seed = 0;
+};
+
+// Everything a restart needs to continue bit-identically
+struct SimulationState {
+    std::vector<Sphere> spheres;
+    std::vector<uint32_t> sweepOrder; // Broadphase order; decides the order overlaps are resolved in. May be empty
+    SimulationClock clock;
+};
+
+// The bytes writeCheckpoint() would write, into 'image'. Exactly the state a restart continues from,
+// so equal images mean equal runs. Returns false, after printing to stderr, if the sweep order does not
+// match the bodies or the image cannot be allocated
+bool buildCheckpointImage(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& sweepOrder,
+                          const SimulationClock& clock, std::vector<unsigned char>& image);
+// Bytes of a checkpoint of 'bodyCount' bodies with their sweep order, e.g. to size an image buffer up front
+uint64_t checkpointSize(uint64_t bodyCount);
+// Returns false, after printing to stderr, if the file could not be written completely
+bool writeCheckpoint(const char* path, const std::vector<Sphere>& spheres, const std::vector<uint32_t>& sweepOrder,
+                     const SimulationClock& clock);
+// Same for an image from buildCheckpointImage(), written through 'tempPath'. Periodic checkpoints keep
+// the image and the path between calls, so writing one does not allocate
+bool writeCheckpointImage(const char* path, const char* tempPath, const std::vector<unsigned char>& image);
+// Returns false, after printing to stderr, if the file is missing, truncated or of another version
+bool readCheckpoint(const char* path, SimulationState& state);
+
+#endif
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "particle_codec.hpp"
+#include "scenarios.hpp"
+#include "trajectory.hpp"
+
+// Codec check: ParticleCodec must give back every bit in lossless mode, whatever the data and however
+// odd the frame size or count, and every value to within the tolerance in lossy mode. TrajectoryReader
+// must give back the frames TrajectoryWriter was given, in any order, in every compression mode, from a
+// file whose writer died mid-chunk, and from one whose index is damaged. Exits with 1 on any mismatch.
+// Writes codec_check.traj and a truncated copy, which are removed afterwards. Built and run by
+// 'make codec-check'.
+
+static const size_t BODY_COUNTS[] = {1, 7, 1025};
+static const size_t FRAME_COUNTS[] = {1, 2, 3, 16};
+// Enough words that every byte plane is cut into several segments
+static const size_t MANY_BODIES = 30000;
+static const float TOLERANCES[] = {1e-4f, 1e-3f, 1e-2f};
+
+static const char* const TRAJECTORY_PATH = "codec_check.traj";
+static const char* const TRUNCATED_PATH = "codec_check.traj.cut";
+static const size_t TRAJECTORY_BODIES = 37;
+// Three full chunks and a short one
+static const uint64_t TRAJECTORY_FRAMES = 3 * TRAJECTORY_FRAMES_PER_CHUNK + 5;
+// Seconds between trajectory frames
+static const float FRAME_DT = 1.f / 60.f;
+
+// Kinds of data the codec must survive
+enum Pattern { PATTERN_SMOOTH, PATTERN_NOISE, PATTERN_CONSTANT, PATTERN_ZERO, PATTERN_CONSTANT_HIGH_BYTES };
+static const char* const PATTERN_NAMES[] = {"smooth", "noise", "constant", "zero", "constant high bytes"};
+
+// 'frameCount' frames of 'bodies' vec3s of the given pattern, as words
+static std::vector<uint32_t> makeWords(Pattern pattern, size_t bodies, size_t frameCount, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    size_t frameWords = bodies * 3;
+    std::vector<uint32_t> words(frameCount * frameWords);
+    std::vector<float> start(frameWords), velocity(frameWords);
+    for (size_t w = 0; w < frameWords; w++) {
+        start[w] = 100.f * unit(random);
+        velocity[w] = unit(random);
+    }
+    for (size_t f = 0; f < frameCount; f++) {
+        for (size_t w = 0; w < frameWords; w++) {
+            uint32_t &word = words[f * frameWords + w];
+            switch (pattern) {
+                case PATTERN_SMOOTH: {
+                    float t = f * FRAME_DT;
+                    float value = start[w] + velocity[w] * t - 4.9f * t * t;
+                    std::memcpy(&word, &value, sizeof(word));
+                    break;
+                }
+                case PATTERN_NOISE: word = uint32_t(random()); break;
+                case PATTERN_CONSTANT: word = 0x3f800000; break;
+                case PATTERN_ZERO: word = 0; break;
+                case PATTERN_CONSTANT_HIGH_BYTES: word = 0x41200000 | (uint32_t(random()) & 0xffff); break;
+            }
+        }
+    }
+    return words;
+}
+
+// One lossless round trip. Encodes after a few bytes that are already in the buffer, and decodes with
+// a codec of its own, so neither depends on state left from encoding
+static bool checkLossless(Pattern pattern, size_t bodies, size_t frameCount, WorkerPool& pool) {
+    size_t frameWords = bodies * 3;
+    std::vector<uint32_t> words = makeWords(pattern, bodies, frameCount, uint32_t(bodies * 131 + frameCount));
+    std::vector<unsigned char> encoded = {0xde, 0xad, 0xbe};
+    ParticleCodec encoder;
+    encoder.encodeLossless(words.data(), frameCount, frameWords, encoded, pool);
+
+    ParticleCodec decoder;
+    std::vector<uint32_t> decoded(words.size(), 0xcdcdcdcd);
+    bool ok = decoder.decodeLossless(encoded.data() + 3, encoded.size() - 3, frameCount, frameWords, decoded.data()) &&
+              decoded == words;
+    if (!ok) {
+        std::cout << "\n  " << PATTERN_NAMES[pattern] << ", " << bodies << " bodies, " << frameCount
+                  << " frames: not bit-exact";
+    }
+    return ok;
+}
+
+// Largest error a lossy value may have: the tolerance, plus rounding the decoded value to float
+static double lossyBound(float original, float tolerance) {
+    float top = std::fabs(original) + tolerance;
+    return tolerance + 0.5 * (double(std::nextafter(top, INFINITY)) - top);
+}
+
+// One lossy round trip of smooth motion around 'offset'; far from the origin a float step is larger
+// than the tolerance. Keeps the largest error as a fraction of lossyBound() in 'worst'
+static bool checkLossy(size_t bodies, size_t frameCount, float tolerance, float offset, WorkerPool& pool, double& worst) {
+    size_t frameWords = bodies * 3;
+    std::vector<uint32_t> words = makeWords(PATTERN_SMOOTH, bodies, frameCount, uint32_t(bodies * 7 + frameCount));
+    std::vector<float> values(words.size());
+    for (size_t w = 0; w < words.size(); w++) {
+        std::memcpy(&values[w], &words[w], sizeof(float));
+        values[w] += offset;
+    }
+    std::vector<unsigned char> encoded;
+    ParticleCodec encoder;
+    ParticleCodec decoder;
+    std::vector<float> decoded(values.size(), NAN);
+    bool ok = encoder.encodeLossy(values.data(), frameCount, frameWords, 3, tolerance, encoded, pool) &&
+              decoder.decodeLossy(encoded.data(), encoded.size(), frameCount, frameWords, decoded.data());
+    for (size_t w = 0; ok && w < values.size(); w++) {
+        double error = std::fabs(double(decoded[w]) - values[w]);
+        double bound = lossyBound(values[w], tolerance);
+        ok = error <= bound;
+        worst = std::max(worst, error / bound);
+    }
+    if (!ok) {
+        std::cout << "\n  " << bodies << " bodies, " << frameCount << " frames, tolerance " << tolerance << ", offset "
+                  << offset << ": not within the tolerance";
+    }
+    return ok;
+}
+
+// Non-finite values cannot be quantized; the encoder must refuse them without writing anything
+static bool checkLossyRejects(WorkerPool& pool) {
+    std::vector<float> values(3 * 7 * 2, 1.f);
+    std::vector<unsigned char> encoded = {1, 2, 3};
+    ParticleCodec codec;
+    bool ok = true;
+    for (float bad : {NAN, INFINITY, -INFINITY}) {
+        values[10] = bad;
+        ok = !codec.encodeLossy(values.data(), 2, 3 * 7, 3, 1e-3f, encoded, pool) && encoded.size() == 3 && ok;
+    }
+    if (!ok) std::cout << "\n  non-finite values were encoded";
+    return ok;
+}
+
+// Bodies moving smoothly, with radius and mass constant, for trajectory files
+static std::vector<std::vector<Sphere>> makeFrames() {
+    std::vector<Sphere> spheres = generateScenario(Scenario::Cluster, TRAJECTORY_BODIES);
+    std::vector<std::vector<Sphere>> frames;
+    for (uint64_t f = 0; f < TRAJECTORY_FRAMES; f++) {
+        frames.push_back(spheres);
+        for (Sphere &sphere : spheres) {
+            sphere.vel -= 0.5f * sphere.pos * FRAME_DT;
+            sphere.pos += sphere.vel * FRAME_DT;
+        }
+    }
+    return frames;
+}
+
+static bool writeTrajectory(const char* path, const std::vector<std::vector<Sphere>>& frames, const TrajectoryOptions& options) {
+    TrajectoryWriter writer;
+    if (!writer.open(path, TRAJECTORY_BODIES, options)) return false;
+    for (uint64_t f = 0; f < frames.size(); f++) writer.append(frames[f], 10 * f, 10 * f * double(FRAME_DT));
+    return writer.close();
+}
+
+static bool sameBits(const void* a, const void* b, size_t size) {
+    return std::memcmp(a, b, size) == 0;
+}
+
+// Whether frame 'f' read back matches what was written: positions to within 'tolerance' (bit-exact
+// for 0), everything else bit-exact
+static bool frameMatches(const TrajectoryReader& reader, uint64_t f, const std::vector<Sphere>& original, float tolerance) {
+    TrajectoryFrame frame;
+    if (!reader.readFrame(f, frame)) return false;
+    if (frame.step != 10 * f || frame.simTime != 10 * f * double(FRAME_DT)) return false;
+    if (frame.positions.size() != original.size() || frame.velocities.size() != original.size() ||
+        frame.radii.size() != original.size() || frame.masses.size() != original.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < original.size(); i++) {
+        const Sphere &sphere = original[i];
+        if (tolerance == 0.f) {
+            if (!sameBits(&frame.positions[i], &sphere.pos, sizeof(glm::vec3))) return false;
+        } else {
+            for (int c = 0; c < 3; c++) {
+                if (!(std::fabs(double(frame.positions[i][c]) - sphere.pos[c]) <= lossyBound(sphere.pos[c], tolerance))) return false;
+            }
+        }
+        if (!sameBits(&frame.velocities[i], &sphere.vel, sizeof(glm::vec3)) || !sameBits(&frame.radii[i], &sphere.radius, sizeof(float)) ||
+            !sameBits(&frame.masses[i], &sphere.mass, sizeof(float))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Frames read forwards, backwards and in a scattered order, each compared with what was written
+static bool checkRandomAccess(const char* name, const TrajectoryOptions& options, const std::vector<std::vector<Sphere>>& frames) {
+    float tolerance = options.compression == TRAJECTORY_LOSSY ? options.tolerance : 0.f;
+    TrajectoryReader reader;
+    if (!writeTrajectory(TRAJECTORY_PATH, frames, options) || !reader.open(TRAJECTORY_PATH) ||
+        reader.frameCount() != frames.size() || reader.bodyCount() != TRAJECTORY_BODIES) {
+        std::cout << "\n  " << name << ": cannot write or open the file";
+        return false;
+    }
+    uint64_t count = frames.size();
+    std::vector<uint64_t> order;
+    for (uint64_t f = 0; f < count; f++) order.push_back(f);
+    for (uint64_t f = count; f-- > 0;) order.push_back(f);
+    // 17 is coprime to the frame count, so this visits every frame, jumping between chunks
+    for (uint64_t k = 0; k < count; k++) order.push_back(k * 17 % count);
+    for (uint64_t f : order) {
+        if (!frameMatches(reader, f, frames[f], tolerance)) {
+            std::cout << "\n  " << name << ": frame " << f << " differs";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cuts the file at every 97th byte, as if the writer died there, and checks that what a reader recovers
+// are whole chunks that match, never fewer as the cut moves on, and all frames once only the index is lost
+static bool checkTruncated(const std::vector<std::vector<Sphere>>& frames) {
+    TrajectoryOptions options;
+    options.fields = TRAJECTORY_FULL_STATE;
+    options.compression = TRAJECTORY_LOSSLESS;
+    if (!writeTrajectory(TRAJECTORY_PATH, frames, options)) return false;
+    uint64_t fileSize = std::filesystem::file_size(TRAJECTORY_PATH);
+
+    // The reader reports the missing index on stderr for every cut
+    std::streambuf* errors = std::cerr.rdbuf(nullptr);
+    bool ok = true;
+    bool midChunk = false;
+    uint64_t recovered = 0;
+    for (uint64_t cut = 64; ok && cut < fileSize; cut += 97) {
+        std::filesystem::copy_file(TRAJECTORY_PATH, TRUNCATED_PATH, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::resize_file(TRUNCATED_PATH, cut);
+        TrajectoryReader reader;
+        if (!reader.open(TRUNCATED_PATH)) {
+            std::cout << "\n  cut at byte " << cut << ": cannot open";
+            ok = false;
+            break;
+        }
+        uint64_t count = reader.frameCount();
+        bool whole = count % TRAJECTORY_FRAMES_PER_CHUNK == 0 || count == frames.size();
+        if (count < recovered || !whole) {
+            std::cout << "\n  cut at byte " << cut << ": recovered " << count << " frames after " << recovered;
+            ok = false;
+        }
+        for (uint64_t f = 0; ok && f < count; f++) {
+            if (!frameMatches(reader, f, frames[f], 0.f)) {
+                std::cout << "\n  cut at byte " << cut << ": frame " << f << " differs";
+                ok = false;
+            }
+        }
+        midChunk = midChunk || (count > 0 && count < frames.size());
+        recovered = count;
+    }
+    std::cerr.rdbuf(errors);
+    std::remove(TRUNCATED_PATH);
+    if (ok && (!midChunk || recovered != frames.size())) {
+        std::cout << "\n  recovered " << recovered << " of " << frames.size() << " frames without the index";
+        ok = false;
+    }
+    return ok;
+}
+
+// A footer whose counts are huge but wrap around to the right index size, as a damaged one might. The
+// reader must notice and fall back to scanning the chunks, which still finds every frame
+static bool checkDamagedIndex(const std::vector<std::vector<Sphere>>& frames) {
+    TrajectoryOptions options;
+    options.fields = TRAJECTORY_FULL_STATE;
+    if (!writeTrajectory(TRAJECTORY_PATH, frames, options)) return false;
+    std::vector<char> file(std::filesystem::file_size(TRAJECTORY_PATH));
+    std::FILE* stream = std::fopen(TRAJECTORY_PATH, "r+b");
+    if (!stream || std::fread(file.data(), 1, file.size(), stream) != file.size()) {
+        if (stream) std::fclose(stream);
+        return false;
+    }
+    // Footer: magic, index offset, chunk count, frame count
+    uint64_t footer[4];
+    std::memcpy(footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+    // k chunks of 16 frames take 264 k index bytes; pick k so that wraps to the real size
+    uint64_t indexSize = footer[2] * 8 + footer[3] * 16;
+    uint64_t inverse = 33; // Of 33 modulo 2^64, by Newton's iteration
+    for (int i = 0; i < 5; i++) inverse *= 2 - 33 * inverse;
+    uint64_t chunks = (indexSize / 8 * inverse) & ((uint64_t(1) << 61) - 1);
+    footer[2] = chunks;
+    footer[3] = chunks * TRAJECTORY_FRAMES_PER_CHUNK;
+    std::fseek(stream, long(file.size() - sizeof(footer)), SEEK_SET);
+    std::fwrite(footer, 1, sizeof(footer), stream);
+    std::fclose(stream);
+
+    std::streambuf* errors = std::cerr.rdbuf(nullptr);
+    TrajectoryReader reader;
+    bool ok = reader.open(TRAJECTORY_PATH) && reader.frameCount() == frames.size();
+    for (uint64_t f = 0; ok && f < frames.size(); f++) ok = frameMatches(reader, f, frames[f], 0.f);
+    std::cerr.rdbuf(errors);
+    if (!ok) std::cout << "\n  frames lost or wrong after the index was damaged";
+    return ok;
+}
+
+int main() {
+    WorkerPool pool(2);
+    bool passed = true;
+
+    std::cout << "lossless codec:";
+    bool exact = true;
+    for (unsigned int pattern = 0; pattern < sizeof(PATTERN_NAMES) / sizeof(PATTERN_NAMES[0]); pattern++) {
+        for (size_t bodies : BODY_COUNTS) {
+            for (size_t frameCount : FRAME_COUNTS) exact = checkLossless(Pattern(pattern), bodies, frameCount, pool) && exact;
+        }
+        exact = checkLossless(Pattern(pattern), MANY_BODIES, 16, pool) && exact;
+    }
+    std::cout << (exact ? " bit-exact\n" : "\n");
+    passed = passed && exact;
+
+    std::cout << "lossy codec:";
+    bool bounded = checkLossyRejects(pool);
+    double worst = 0.0;
+    for (float tolerance : TOLERANCES) {
+        for (float offset : {0.f, 3e4f}) {
+            for (size_t bodies : BODY_COUNTS) {
+                for (size_t frameCount : FRAME_COUNTS) bounded = checkLossy(bodies, frameCount, tolerance, offset, pool, worst) && bounded;
+            }
+        }
+    }
+    if (bounded) std::cout << " within the tolerance, largest error " << worst << " of the bound\n";
+    else std::cout << "\n";
+    passed = passed && bounded;
+
+    std::vector<std::vector<Sphere>> frames = makeFrames();
+    const char* modeNames[] = {"uncompressed", "lossless", "lossy"};
+    for (TrajectoryCompression compression : {TRAJECTORY_UNCOMPRESSED, TRAJECTORY_LOSSLESS, TRAJECTORY_LOSSY}) {
+        TrajectoryOptions options;
+        options.fields = TRAJECTORY_FULL_STATE;
+        options.compression = compression;
+        options.compressionThreads = 2;
+        std::cout << modeNames[compression] << " trajectory:";
+        bool ok = checkRandomAccess(modeNames[compression], options, frames);
+        std::cout << (ok ? " random access matches\n" : "\n");
+        passed = passed && ok;
+    }
+    std::remove(TRAJECTORY_PATH);
+
+    std::cout << "truncated trajectory:";
+    bool recovered = checkTruncated(frames);
+    std::cout << (recovered ? " complete chunks recovered\n" : "\n");
+    passed = passed && recovered;
+
+    std::cout << "damaged trajectory index:";
+    bool scanned = checkDamagedIndex(frames);
+    std::cout << (scanned ? " chunks scanned instead\n" : "\n");
+    passed = passed && scanned;
+    std::remove(TRAJECTORY_PATH);
+
+    std::cout << (passed ? "Codecs and trajectories round-trip\n" : "FAILED: codec or trajectory mismatch\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "option_parsing.hpp"
+#include "physics_thread.hpp"
+#include "scenarios.hpp"
+
+// Determinism check: steps every scenario with each force solver in deterministic mode, twice per
+// thread count, and compares the bits of the whole final state. Exits with 1 if any run differs from the
+// first one. Also prints the time per step against the default (load balanced) mode, i.e. what
+// determinism costs on this machine. Built and run by 'make determinism'.
+//
+// Options, all optional:
+//   --scenarios uniform,cluster,disk,collision,clumps
+//   --bodies 1000
+//   --steps 50
+//   --threads 1,2,3,8       threads per run; counts above the CPU count are fine, they only interleave more
+
+struct DeterminismOptions {
+    std::vector<Scenario> scenarios;
+    size_t bodies = 1000;
+    uint64_t steps = 50;
+    std::vector<unsigned int> threads = {1, 2, 3, 8};
+};
+
+static bool parseOptions(int argc, char** argv, DeterminismOptions& options) {
+    options.scenarios.assign(SCENARIOS, SCENARIOS + SCENARIO_COUNT);
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        std::vector<uint64_t> numbers;
+        if (std::strcmp(option, "--scenarios") == 0) {
+            if (!parseScenarioList(value, options.scenarios)) return false;
+        } else if (std::strcmp(option, "--threads") == 0) {
+            if (!parseNumberList(value, options.threads)) return false;
+        } else if (std::strcmp(option, "--bodies") == 0 || std::strcmp(option, "--steps") == 0) {
+            if (!parseNumberList(value, numbers) || numbers.size() != 1) return false;
+            if (option[2] == 'b') options.bodies = numbers[0];
+            else options.steps = numbers[0];
+        } else {
+            std::cerr << "Unknown option " << option << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// FNV-1a over the bytes of the final state as a checkpoint holds it: every field of every body,
+// positions, velocities and accelerations included, the sweep order and the clock. Equal hashes
+// mean a restart from either run would continue identically
+static uint64_t hashState(const PhysicsThread& physics) {
+    std::vector<unsigned char> image;
+    if (!physics.checkpointImage(image)) return 0;
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char byte : image) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// One headless run; returns the hash of the final state and the milliseconds per step
+static uint64_t runSteps(const std::vector<Sphere>& spheres, const SolverConfig& config, unsigned int threads, uint64_t steps,
+                         bool deterministic, double& milliseconds) {
+    PhysicsThread physics;
+    physics.setSolver(config);
+    physics.setDeterministic(deterministic);
+    auto start = std::chrono::steady_clock::now();
+    physics.run(spheres, steps, threads - 1);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    milliseconds = elapsed.count() / steps;
+    return hashState(physics);
+}
+
+int main(int argc, char** argv) {
+    DeterminismOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--scenarios a,b] [--bodies n] [--steps n] [--threads a,b]\n";
+        return 1;
+    }
+
+    bool identical = true;
+    for (Scenario scenario : options.scenarios) {
+        std::vector<Sphere> spheres = generateScenario(scenario, options.bodies);
+        for (ForceSolver solver : {ForceSolver::Direct, ForceSolver::BarnesHut}) {
+            SolverConfig config;
+            config.solver = solver;
+            std::cout << scenarioName(scenario) << ", " << solverName(solver) << ":";
+
+            uint64_t reference = 0;
+            bool first = true;
+            for (unsigned int threads : options.threads) {
+                for (unsigned int repeat = 0; repeat < 2; repeat++) {
+                    double deterministicMs, defaultMs;
+                    uint64_t hash = runSteps(spheres, config, threads, options.steps, true, deterministicMs);
+                    if (first) reference = hash;
+                    first = false;
+                    if (hash != reference) {
+                        std::cout << "\n  " << threads << " threads, run " << repeat + 1 << ": state differs (" << std::hex
+                                  << hash << " instead of " << reference << std::dec << ")";
+                        identical = false;
+                    }
+                    if (repeat > 0) continue;
+                    runSteps(spheres, config, threads, options.steps, false, defaultMs);
+                    std::cout << "\n  " << threads << " threads: " << deterministicMs << " ms/step deterministic, "
+                              << defaultMs << " ms/step default";
+                }
+            }
+            std::cout << "\n  final state " << std::hex << reference << std::dec << "\n";
+        }
+    }
+    std::cout << (identical ? "Every run is bit-identical\n" : "FAILED: runs differ\n");
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include <cstring>
+
+#include "force_solver.hpp"
+#include "perf_counters.hpp"
+
+// Floating point operations per pair in computeForces, for GFLOP/s reports.
+// Counted from the source: vector differences, length with sqrt, the force scale and applyForce
+static const double FLOPS_PER_PAIR = 30.0;
+
+struct ForceJob {
+    std::vector<Sphere>* spheres;
+    const SolverConfig* config;
+    const BarnesHutTree* tree;
+};
+
+static void forceRange(void* context, size_t begin, size_t end) {
+    const ForceJob &job = *static_cast<ForceJob*>(context);
+    std::vector<Sphere> &spheres = *job.spheres;
+    if (job.config->solver == ForceSolver::BarnesHut) {
+        // Interactions per body vary with the tree, so only bodies are counted
+        PerfScope counters(PERF_FORCE, end - begin);
+        job.tree->computeForces(spheres, begin, end, job.config->theta);
+    } else {
+        PerfScope counters(PERF_FORCE, (end - begin) * (spheres.size() - 1), FLOPS_PER_PAIR);
+        computeForces(spheres, begin, end);
+    }
+}
+
+const char* solverName(ForceSolver solver) {
+    switch (solver) {
+        case ForceSolver::Direct: return "direct";
+        case ForceSolver::BarnesHut: return "barnes-hut";
+    }
+    return "unknown";
+}
+
+bool parseSolver(const char* name, ForceSolver& solver) {
+    for (ForceSolver candidate : {ForceSolver::Direct, ForceSolver::BarnesHut}) {
+        if (std::strcmp(name, solverName(candidate)) == 0) {
+            solver = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+glm::dvec3 referenceAcceleration(const std::vector<Sphere>& spheres, size_t i) {
+    const Sphere &circle = spheres[i];
+    glm::dvec3 acc(0.0);
+    for (size_t j = 0; j < spheres.size(); j++) {
+        if (j == i) continue;
+        const Sphere &circle2 = spheres[j];
+        glm::dvec3 dr = glm::dvec3(circle2.pos) - glm::dvec3(circle.pos);
+        double dist = glm::length(dr);
+        // Same rule as computeForces: touching spheres exert no gravity on each other
+        if (dist < double(circle.radius) + double(circle2.radius)) continue;
+        acc += dr / dist * (double(G) * circle2.mass / (1e9 * dist * dist));
+    }
+    return acc;
+}
+
+void computeForcesParallel(WorkerPool& pool, std::vector<Sphere>& spheres, size_t count, const SolverConfig& config,
+                           const BarnesHutTree& tree, size_t fixedChunk) {
+    ForceJob job = {&spheres, &config, &tree};
+    if (fixedChunk) pool.parallelForChunks(count, fixedChunk, forceRange, &job);
+    else pool.parallelFor(count, config.grain, forceRange, &job, config.threads);
+}
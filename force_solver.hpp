@@ -0,0 +1,41 @@
+#ifndef FORCE_SOLVER_HPP
+#define FORCE_SOLVER_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "barnes_hut.hpp"
+#include "physics.hpp"
+#include "task_graph.hpp"
+
+enum class ForceSolver {
+    Direct,   // Exact O(N^2) pair sum, computeForces
+    BarnesHut // O(N log N) octree approximation, BarnesHutTree
+};
+
+// How the force phase runs. The defaults are the exact direct sum on every thread
+struct SolverConfig {
+    ForceSolver solver = ForceSolver::Direct;
+    float theta = 0.5f; // Barnes-Hut opening angle; larger is faster and less accurate
+    unsigned int leafSize = 8; // Barnes-Hut bodies per leaf
+    unsigned int threads = 0; // Threads of the pool to use; 0 for all
+    size_t grain = 16; // Smallest range of bodies handed to a thread
+};
+
+const char* solverName(ForceSolver solver);
+// Accepts the names returned by solverName
+bool parseSolver(const char* name, ForceSolver& solver);
+
+// Acceleration of sphere i by the direct sum in double precision: the reference that approximate
+// solvers, and computeForces' own float rounding, are measured against
+glm::dvec3 referenceAcceleration(const std::vector<Sphere>& spheres, size_t i);
+
+// Accelerations of spheres [0, count), split over 'pool' as 'config' says. For Barnes-Hut the
+// tree must have been built from 'spheres' with config.leafSize. A nonzero 'fixedChunk' replaces
+// config.threads and config.grain: chunks of exactly that many bodies on every thread of the pool
+void computeForcesParallel(WorkerPool& pool, std::vector<Sphere>& spheres, size_t count, const SolverConfig& config,
+                           const BarnesHutTree& tree, size_t fixedChunk = 0);
+
+#endif
@@ -0,0 +1,111 @@
+#include <iostream>
+
+#include "gpu_profiler.hpp"
+#include "profiler.hpp"
+
+// GPU and CPU clocks drift apart slowly; re-measure the offset this often
+static const uint64_t CALIBRATION_INTERVAL = 300;
+
+bool GpuProfiler::create() {
+    // Timer queries are core since GL 3.3, but the counter may still have no bits
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if (bits == 0) {
+        std::cerr << "GPU timer queries not supported, GPU profiling disabled\n";
+        return false;
+    }
+
+    glGenQueries(FRAME_LATENCY * 2 * MAX_ZONES, &queries[0][0]);
+    for (auto &frame : frames) frame = Frame();
+    current = 0;
+    enabled = true;
+    calibrate();
+#ifdef GRAVITY_PROFILER
+    if (track == 0) track = profilerTrack("gpu");
+#endif
+    return true;
+}
+
+void GpuProfiler::destroy() {
+    if (!enabled) return;
+    glDeleteQueries(FRAME_LATENCY * 2 * MAX_ZONES, &queries[0][0]);
+    enabled = false;
+}
+
+void GpuProfiler::calibrate() {
+    // Current GPU time, read without waiting for queued commands, paired with the CPU clock
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    clockOffset = int64_t(profilerNow()) - gpuTime;
+    framesSinceCalibration = 0;
+}
+
+void GpuProfiler::beginFrame() {
+    if (!enabled) return;
+    // The slot was issued FRAME_LATENCY frames ago; collect it before reusing its queries
+    if (frames[current].issued) readBack(current);
+    frames[current].zoneCount = 0;
+    frames[current].issued = false;
+    openCount = 0;
+    zoneDepth = 0;
+
+    if (++framesSinceCalibration >= CALIBRATION_INTERVAL) calibrate();
+}
+
+void GpuProfiler::endFrame() {
+    if (!enabled) return;
+    // Close zones left open, so every query of the frame is issued
+    while (zoneDepth > 0) end();
+    frames[current].issued = frames[current].zoneCount > 0;
+    current = (current + 1) % FRAME_LATENCY;
+}
+
+void GpuProfiler::begin(const char* name) {
+    if (!enabled) return;
+    zoneDepth++;
+    Frame &frame = frames[current];
+    if (frame.zoneCount == MAX_ZONES) return;
+
+    unsigned int zone = frame.zoneCount++;
+    frame.names[zone] = name;
+    openZones[openCount++] = zone;
+    glQueryCounter(queries[current][2 * zone], GL_TIMESTAMP);
+}
+
+void GpuProfiler::end() {
+    if (!enabled || zoneDepth == 0) return;
+    // Zones past MAX_ZONES were never opened; they are always the innermost ones
+    if (zoneDepth-- > openCount) return;
+    unsigned int zone = openZones[--openCount];
+    frames[current].lastQuery = 2 * zone + 1;
+    glQueryCounter(queries[current][2 * zone + 1], GL_TIMESTAMP);
+}
+
+void GpuProfiler::readBack(unsigned int slot) {
+    const Frame &frame = frames[slot];
+    // Queries complete in submission order, so checking the last one covers the whole frame
+    GLuint available = 0;
+    glGetQueryObjectuiv(queries[slot][frame.lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        dropped++;
+        return;
+    }
+
+    uint64_t frameStart = UINT64_MAX;
+    uint64_t frameEnd = 0;
+    for (unsigned int zone = 0; zone < frame.zoneCount; zone++) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(queries[slot][2 * zone], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[slot][2 * zone + 1], GL_QUERY_RESULT, &end);
+        if (start < frameStart) frameStart = start;
+        if (end > frameEnd) frameEnd = end;
+#ifdef GRAVITY_PROFILER
+        profilerRecord(track, frame.names[zone], start + clockOffset, end + clockOffset);
+#endif
+    }
+    lastFrameTime = (frameEnd - frameStart) / 1e6;
+    if (lastFrameTime > maxFrameTime) maxFrameTime = lastFrameTime;
+    totalFrameTime += lastFrameTime;
+    measured++;
+}
@@ -0,0 +1,73 @@
+#ifndef GPU_PROFILER_HPP
+#define GPU_PROFILER_HPP
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// GPU-side timing with timestamp queries (glQueryCounter with GL_TIMESTAMP). Every zone gets a query
+// at its start and end, so zones can nest, which GL_TIME_ELAPSED queries cannot.
+// Results are read back FRAME_LATENCY frames later, when the GPU has long finished them, so
+// profiling never stalls the pipeline. In profiling builds the zones also go to the "gpu" track
+// of the CPU trace (profiler.hpp), aligned to the CPU clock.
+//
+// Per frame: beginFrame(), any number of begin(name) / end() pairs, endFrame().
+// Must be used on the thread that owns the GL context.
+class GpuProfiler {
+    public:
+    static const unsigned int FRAME_LATENCY = 4;
+    static const unsigned int MAX_ZONES = 32; // Per frame; further zones are not timed
+
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Returns false if the context has no timer queries; every other call is a no-op then
+    bool create();
+    void destroy();
+
+    void beginFrame();
+    void endFrame();
+    // 'name' must be a string literal
+    void begin(const char* name);
+    void end();
+
+    // GPU time of the newest frame read back: first zone start to last zone end, in milliseconds
+    double lastFrameMilliseconds() const { return lastFrameTime; }
+    double maxFrameMilliseconds() const { return maxFrameTime; }
+    double averageFrameMilliseconds() const { return measured ? totalFrameTime / measured : 0.0; }
+    uint64_t framesMeasured() const { return measured; }
+    // Frames whose results were not ready after FRAME_LATENCY frames and were skipped
+    uint64_t framesDropped() const { return dropped; }
+
+    private:
+    struct Frame {
+        const char* names[MAX_ZONES];
+        unsigned int zoneCount = 0;
+        unsigned int lastQuery = 0; // Issued last; once it is available, so is every query before it
+        bool issued = false;
+    };
+
+    void readBack(unsigned int slot);
+    void calibrate();
+
+    bool enabled = false;
+    unsigned int queries[FRAME_LATENCY][2 * MAX_ZONES];
+    Frame frames[FRAME_LATENCY];
+    unsigned int current = 0;
+    unsigned int openZones[MAX_ZONES]; // Zone indices of the current frame not yet ended
+    unsigned int openCount = 0;
+    unsigned int zoneDepth = 0; // Including zones past MAX_ZONES, so begin/end stay paired
+
+    int64_t clockOffset = 0; // CPU profiler time minus GPU time, in nanoseconds
+    uint64_t framesSinceCalibration = 0;
+    unsigned int track = 0;
+
+    double lastFrameTime = 0.0;
+    double maxFrameTime = 0.0;
+    double totalFrameTime = 0.0;
+    uint64_t measured = 0;
+    uint64_t dropped = 0;
+};
+
+#endif
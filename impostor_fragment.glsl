@@ -0,0 +1,37 @@
+#version 330 core
+// Ray-casts the sphere behind each impostor quad and writes its true depth
+in vec3 rayDir;
+flat in vec3 sphereCenter;
+flat in float sphereRadius;
+flat in vec3 vertexColor;
+
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection; // Needed to turn the hit point back into window depth
+    float interpolation;
+};
+
+out vec4 FragColor;
+
+const vec3 lightDir = vec3(0.267, 0.535, 0.802); // View space, normalized
+
+void main() {
+    // Ray from the eye (origin) through this fragment: p = t * dir
+    vec3 dir = normalize(rayDir);
+    float b = dot(dir, sphereCenter);
+    float c = dot(sphereCenter, sphereCenter) - sphereRadius * sphereRadius;
+    float disc = b * b - c;
+    if (disc < 0.0) discard; // Ray misses the sphere: outside the silhouette
+
+    float t = b - sqrt(disc); // Nearest intersection
+    if (t < 0.0) t = b + sqrt(disc); // Eye inside the sphere: use the far side
+    vec3 hit = dir * t;
+    vec3 normal = (hit - sphereCenter) / sphereRadius; // Analytic normal, already unit length
+
+    vec4 clipPos = projection * vec4(hit, 1.0);
+    float ndcDepth = clipPos.z / clipPos.w;
+    gl_FragDepth = 0.5 * (gl_DepthRange.diff * ndcDepth + gl_DepthRange.near + gl_DepthRange.far);
+
+    float diffuse = max(dot(normal, lightDir), 0.0);
+    FragColor = vec4(vertexColor * (0.35 + 0.65 * diffuse), 1.0);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+// Sphere impostor: one camera-facing quad per body, expanded from gl_VertexID.
+// Draw with GL_TRIANGLE_STRIP, 4 vertices, one instance per sphere.
+layout(location=1) in vec4 aInstance; // Per-instance: xyz = sphere position, w = radius
+layout(location=2) in vec4 aColor; // Per-instance color
+layout(location=3) in vec3 aPrevPos; // Per-instance: sphere position one physics step earlier
+
+layout(std140) uniform Frame { // Updated once per frame, shared by all programs
+    mat4 view; // Camera transformation
+    mat4 projection; // Perspective projection
+    float interpolation; // 0 = previous physics step, 1 = latest step
+};
+
+out vec3 rayDir; // View-space point on the quad; the eye is at the origin
+flat out vec3 sphereCenter; // View-space sphere center
+flat out float sphereRadius;
+flat out vec3 vertexColor;
+
+void main() {
+    vec3 worldCenter = mix(aPrevPos, aInstance.xyz, interpolation); // Smooth motion between physics steps
+    vec3 center = (view * vec4(worldCenter, 1.0)).xyz;
+    float r = aInstance.w;
+
+    // Quad through the center, perpendicular to the eye->center line.
+    // Its half-size is the radius of the silhouette cone at that distance, so it covers the sphere exactly
+    float d = length(center);
+    vec3 axis = center / d;
+    vec3 right = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 up = cross(right, axis);
+    float halfSize = d > r * 1.0001 ? r * d / sqrt(d * d - r * r) : 1e3 * r; // Eye inside the sphere: just cover the view
+
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+    vec3 quadPos = center + (corner.x * right + corner.y * up) * halfSize;
+
+    rayDir = quadPos;
+    sphereCenter = center;
+    sphereRadius = r;
+    vertexColor = aColor.rgb;
+    gl_Position = projection * vec4(quadPos, 1.0);
+}
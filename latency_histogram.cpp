@@ -0,0 +1,72 @@
+#include <cstdio>
+
+#include "latency_histogram.hpp"
+
+unsigned int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) return value;
+    // Position of the highest set bit; the SUB_BUCKET_BITS bits from there down select the bucket
+    unsigned int magnitude = 63 - __builtin_clzll(value);
+    unsigned int shift = magnitude - (SUB_BUCKET_BITS - 1);
+    unsigned int subBucket = value >> shift; // In [HALF_COUNT, SUB_BUCKET_COUNT)
+    return SUB_BUCKET_COUNT + (magnitude - SUB_BUCKET_BITS) * HALF_COUNT + (subBucket - HALF_COUNT);
+}
+
+uint64_t LatencyHistogram::bucketHighest(unsigned int index) {
+    if (index < SUB_BUCKET_COUNT) return index;
+    unsigned int magnitude = (index - SUB_BUCKET_COUNT) / HALF_COUNT + SUB_BUCKET_BITS;
+    uint64_t subBucket = (index - SUB_BUCKET_COUNT) % HALF_COUNT + HALF_COUNT;
+    unsigned int shift = magnitude - (SUB_BUCKET_BITS - 1);
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    counts[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    uint64_t previous = maximum.load(std::memory_order_relaxed);
+    while (nanoseconds > previous && !maximum.compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() {
+    for (auto &count : counts) count.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+    uint64_t value = 0;
+    percentiles(&percentile, &value, 1);
+    return value;
+}
+
+void LatencyHistogram::percentiles(const double* percentiles, uint64_t* values, unsigned int count) const {
+    // Sum the buckets rather than trusting 'total': concurrent records may have bumped one but not the other
+    uint64_t samples = 0;
+    for (const auto &bucket : counts) samples += bucket.load(std::memory_order_relaxed);
+
+    unsigned int next = 0;
+    uint64_t seen = 0;
+    for (unsigned int index = 0; index < BUCKET_COUNT && next < count; index++) {
+        seen += counts[index].load(std::memory_order_relaxed);
+        while (next < count && seen > 0 && seen >= percentiles[next] / 100.0 * samples) {
+            // The bucket's top is reported, but never more than the true maximum
+            uint64_t highest = bucketHighest(index);
+            uint64_t top = max();
+            values[next++] = highest < top ? highest : top;
+        }
+    }
+    for (; next < count; next++) values[next] = 0;
+}
+
+void printLatencyReport(std::ostream& out, const char* name, const LatencyHistogram& histogram) {
+    char line[160];
+    formatLatencyLine(line, sizeof(line), name, histogram);
+    out << line << "\n";
+}
+
+void formatLatencyLine(char* buffer, size_t size, const char* name, const LatencyHistogram& histogram) {
+    uint64_t values[LATENCY_PERCENTILE_COUNT];
+    histogram.percentiles(LATENCY_PERCENTILES, values, LATENCY_PERCENTILE_COUNT);
+    snprintf(buffer, size, "%s: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms (%llu samples)", name,
+             values[0] / 1e6, values[1] / 1e6, values[2] / 1e6, values[3] / 1e6, histogram.max() / 1e6,
+             (unsigned long long)histogram.count());
+}
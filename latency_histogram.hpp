@@ -0,0 +1,54 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// High-dynamic-range histogram of durations in nanoseconds (the HdrHistogram bucket layout).
+// Buckets are linear within each power of two, with SUB_BUCKET_BITS bits of precision, so every
+// recorded value keeps under 1% relative error from 1 ns up to centuries.
+// record() is lock-free and wait-free, so any thread can add samples while another reads percentiles
+class LatencyHistogram {
+    public:
+    static const unsigned int SUB_BUCKET_BITS = 8;
+    static const unsigned int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const unsigned int HALF_COUNT = SUB_BUCKET_COUNT / 2;
+    // Values below SUB_BUCKET_COUNT are exact; every further power of two adds HALF_COUNT buckets
+    static const unsigned int BUCKET_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * HALF_COUNT;
+
+    LatencyHistogram() { reset(); }
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t nanoseconds);
+    // Not atomic as a whole: samples recorded during a reset may survive it
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+    // Smallest recorded value that 'percentile' percent of samples are at or below (within the
+    // bucket precision). 0 if empty
+    uint64_t percentile(double percentile) const;
+    // Several percentiles in one pass; 'percentiles' must be ascending
+    void percentiles(const double* percentiles, uint64_t* values, unsigned int count) const;
+
+    private:
+    static unsigned int bucketIndex(uint64_t value);
+    static uint64_t bucketHighest(unsigned int index);
+
+    std::atomic<uint64_t> counts[BUCKET_COUNT];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maximum;
+};
+
+// Percentiles shown in reports and the overlay
+const unsigned int LATENCY_PERCENTILE_COUNT = 4;
+const double LATENCY_PERCENTILES[LATENCY_PERCENTILE_COUNT] = {50.0, 95.0, 99.0, 99.9};
+
+// "name: p50 x ms, p95 x ms, p99 x ms, p99.9 x ms, max x ms (n samples)"
+void printLatencyReport(std::ostream& out, const char* name, const LatencyHistogram& histogram);
+// Same as one fixed-size line, for the overlay. Does not allocate
+void formatLatencyLine(char* buffer, size_t size, const char* name, const LatencyHistogram& histogram);
+
+#endif
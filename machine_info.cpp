@@ -0,0 +1,34 @@
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include "machine_info.hpp"
+
+std::string machineFingerprint() {
+    std::string model = "unknown-cpu";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") != 0) continue;
+        model = line.substr(line.find(':') + 1);
+        break;
+    }
+
+    // Lower-case letters and digits, runs of anything else become one '-'
+    std::string fingerprint;
+    for (char c : model) {
+        if (std::isalnum((unsigned char)c)) fingerprint += std::tolower((unsigned char)c);
+        else if (!fingerprint.empty() && fingerprint.back() != '-') fingerprint += '-';
+    }
+    if (!fingerprint.empty() && fingerprint.back() == '-') fingerprint.pop_back();
+    fingerprint += "-x" + std::to_string(std::thread::hardware_concurrency());
+
+    // The compiler changes code generation as much as the hardware does; too long for the name, so hashed
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (const char* c = __VERSION__; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "-%08x", hash);
+    return fingerprint + suffix;
+}
@@ -0,0 +1,10 @@
+#ifndef MACHINE_INFO_HPP
+#define MACHINE_INFO_HPP
+
+#include <string>
+
+// Identifies the machine and toolchain, so measurements are only compared on like hardware:
+// CPU model, logical CPU count and compiler. Safe to use as a file name
+std::string machineFingerprint();
+
+#endif
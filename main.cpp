@@ -12,11 +12,24 @@
 #include <math.h>
 
 #include "setup.hpp"
+#include "alloc_tracker.hpp"
+#include "profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "perf_counters.hpp"
+#include "latency_histogram.hpp"
+#include "text_overlay.hpp"
+#include "physics_thread.hpp"
+#include "shader_program.hpp"
+#include "stream_buffer.hpp"
+#include "sphere_mesh.hpp"
+#include "visible_instances.hpp"
 
 #include <vector>
 #include <chrono>
-
-const float G = 6.6743E-11;
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 struct vec3 {
     float x, y, z;
@@ -33,120 +46,56 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 }
 
 
-class Sphere {
-    public:
-    glm::vec3 pos;
-    glm::vec3 vel;
-    glm::vec3 acc;
-
-    float radius;
-    float mass;
-
-    Sphere(glm::vec3 pos, glm::vec3 vel, float radius, long double mass) : pos(pos), vel(vel), radius(radius), mass(mass) {
-        acc = glm::vec3(0.f, 0.f, 0.f);
-    }
-
-    void applyForce(glm::vec3 force) {
-        acc += force / mass;
-    }
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
 
-    void updatePos(float dt) {
-        //glm::mat4 transformation = glm::mat4(1.f); // Identity
-        //transformation = glm::translate(transformation, vel);
-        //pos = trans * pos;
-        
-        //glm::vec4 transformedPos = transformation * glm::vec4(pos, 1.0f);
-        //pos = glm::vec3(transformedPos);
-        vel = vel + acc * dt;
-        pos = pos + vel * dt;
-
-        // Collision detection (Window range: -1 to 1)
-        if (pos.x + radius > 1.0f || pos.x - radius < -1.0f){
-            vel.x = -vel.x * 0.75;
-        }
-        if (pos.z + radius > 1.0f || pos.z - radius < -1.0f){
-            vel.z = -vel.z * 0.75;
-        }
-        if (pos.y + radius > 1.0f || pos.y - radius < -1.0f) {
-            vel.y = -vel.y * 0.75;
-            pos.y = glm::clamp(pos.y, -1.0f + radius, 1.0f - radius); // Prevent overshooting
-        }
-    }
+// Per-frame state, std140 layout of the 'Frame' uniform block in the shaders
+struct FrameBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    float interpolation; // Blend factor from prevPos to pos, see PhysicsSnapshot::interpolation
+    float padding[3];
 };
 
-// Generate vertex data
-std::vector<float> generateSphereVertices(unsigned int stackCount, unsigned int sectorCount) {
-    std::vector<float> vertices;
-    
-    float sectorStep = 2.f * M_PI / sectorCount;
-    float stackStep = M_PI / stackCount;
-
-    for (size_t i = 0; i <= stackCount; i++) {
-        float stackAngle = i * stackStep;
-        float xy = sinf(stackAngle);
-        float z = cosf(stackAngle);
-
-        // Add (sectorCount+1) vertices per stack
-        // First and last vertices have same position and normal, but different tex coords.
-
-        for (size_t j = 0; j <= sectorCount; j++) {
-            float sectorAngle = M_PI / 2 - j * sectorStep;
-
-            // vertex position
-            float x = xy * cosf(sectorAngle);
-            float y = xy * sinf(sectorAngle);
-
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-        }
-    }
-    return vertices;
-}
-
-void generateSphereIndices(unsigned int stackCount, unsigned int sectorCount, std::vector<unsigned int>& indices, std::vector<unsigned int>& lineIndices) {
-    for (int i = 0; i < stackCount; ++i) {
-        int k1 = i * (sectorCount + 1); // beginning of current stack
-        int k2 = k1 + sectorCount + 1; // beginning of next stack
-
-        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
-            // 2 triangles per sector excluding first and last stacks.
-
-            // Triangle 1
-            if (i != 0) {
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1 + 1);
-            }
-
-            // Triangle 2
-            if (i != stackCount - 1) {
-                indices.push_back(k1 + 1);
-                indices.push_back(k2);
-                indices.push_back(k2 + 1);
-            }
-
-            // indices for lines
-            // vertical lines for all stacks
-            lineIndices.push_back(k1);
-            lineIndices.push_back(k2);
-
-            if (i != 0) {
-                lineIndices.push_back(k1);
-                lineIndices.push_back(k1 + 1);
-            }
-        }
-    }
-}
-
-const int WIDTH = 1920;
-const int HEIGHT = 1080;
+// Uniform buffer binding point of the 'Frame' block
+const unsigned int FRAME_BLOCK_BINDING = 0;
+
+// Written on exit in profiling builds; open it in ui.perfetto.dev or chrome://tracing
+const char* const PROFILE_TRACE_PATH = "gravity_trace.json";
+
+// Frames between refreshes of the latency overlay text
+const uint64_t OVERLAY_REFRESH_FRAMES = 30;
+
+// Frames after which the render loop must not allocate anymore; buffers grow to size before that
+const uint64_t ALLOCATION_WARMUP_FRAMES = 120;
+// Frames that allocated after warmup which are reported on stderr, to keep a regression from flooding it
+const unsigned int MAX_ALLOCATION_REPORTS = 10;
+// Physics steps between checkpoints when GRAVITY_CHECKPOINT is set: one minute of simulated time
+const uint64_t CHECKPOINT_INTERVAL = 3600;
+// Physics steps between trajectory frames when GRAVITY_TRAJECTORY is set: ten per simulated second
+const uint64_t TRAJECTORY_INTERVAL = 6;
+// Threads compressing trajectory chunks; they share the cores with stepping, which the writer need not keep up with
+const unsigned int TRAJECTORY_COMPRESSION_THREADS = 2;
+
+// How spheres are drawn
+enum class RenderMode {
+    Mesh,    // Tessellated UV-sphere per body
+    Impostor // Screen-facing quad per body, ray-cast in the fragment shader
+};
 
 // Vertex Buffer Object and Vertex Array Object
 unsigned int VAO, VBO;
+// Impostors need no vertex data, only the per-instance attributes
+unsigned int IMPOSTOR_VAO;
 unsigned int EBO, EBO_LINES;
+// Vertex buffer binding index the per-instance attributes are sourced from
+const unsigned int INSTANCE_BINDING = 1;
+
+void initVAOVBO(const SphereMeshCache &sphereMeshes) {
+    const std::vector<float> &sphereVertices = sphereMeshes.vertices;
+    const std::vector<uint16_t> &sphereIndices = sphereMeshes.indices;
+    const std::vector<uint16_t> &sphereLineIndices = sphereMeshes.lineIndices;
 
-void initVAOVBO(std::vector<float> &sphereVertices, std::vector<unsigned int> &sphereIndices, std::vector<unsigned int> &sphereLineIndices) {
     // Generate VAO and bind it
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
@@ -161,11 +110,11 @@ void initVAOVBO(std::vector<float> &sphereVertices, std::vector<unsigned int> &s
     glGenBuffers(1, &EBO);
     // Appropriate target for index data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), sphereIndices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(uint16_t), sphereIndices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &EBO_LINES);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_LINES);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereLineIndices.size() * sizeof(unsigned int), sphereLineIndices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereLineIndices.size() * sizeof(uint16_t), sphereLineIndices.data(), GL_STATIC_DRAW);
 
     // Interpret vertex data determined by object bound to GL_ARRAY_BUFFER (VBO)
     // Position attribute (location = 0 in shader). Vertex is vec3 (floats). No input data normalization
@@ -177,16 +126,51 @@ void initVAOVBO(std::vector<float> &sphereVertices, std::vector<unsigned int> &s
     // Enable it
     glEnableVertexAttribArray(0);
 
-    // Color attribute (location = 1 in shader)
-    // Starts after position data in vertex buffer; appropriate offset
-    //glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    //glEnableVertexAttribArray(1);
+    // Instance attributes (location = 1-3 in shader) come from a separate binding.
+    // Only the format is fixed here; the buffer region is bound every frame with glBindVertexBuffer,
+    // since the streaming buffer hands out a different region each frame.
+    // A divisor of 1 advances them once per instance instead of once per vertex
+    glVertexAttribFormat(1, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, posRadius));
+    glVertexAttribBinding(1, INSTANCE_BINDING);
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribFormat(2, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, color));
+    glVertexAttribBinding(2, INSTANCE_BINDING);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(InstanceData, prevPos));
+    glVertexAttribBinding(3, INSTANCE_BINDING);
+    glEnableVertexAttribArray(3);
+
+    glVertexBindingDivisor(INSTANCE_BINDING, 1);
 
     // Unbind VAO, VBO
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void initImpostorVAO() {
+    // Same instance layout as the mesh VAO, without attribute 0
+    glGenVertexArrays(1, &IMPOSTOR_VAO);
+    glBindVertexArray(IMPOSTOR_VAO);
+
+    glVertexAttribFormat(1, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, posRadius));
+    glVertexAttribBinding(1, INSTANCE_BINDING);
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribFormat(2, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, color));
+    glVertexAttribBinding(2, INSTANCE_BINDING);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(InstanceData, prevPos));
+    glVertexAttribBinding(3, INSTANCE_BINDING);
+    glEnableVertexAttribArray(3);
+
+    glVertexBindingDivisor(INSTANCE_BINDING, 1);
+
+    glBindVertexArray(0);
+}
+
 // Simple camera structure
 struct Camera {
     float orientationSpeed = 0.005f;
@@ -211,6 +195,22 @@ void processInput(GLFWwindow *window, Camera* camera) {
         camera->pos += glm::normalize(glm::cross(camera->front, camera->up)) * camera->orientationSpeed;
 }
 
+// 1: tessellated spheres, 2: ray-cast impostors
+void processRenderModeInput(GLFWwindow *window, RenderMode* renderMode) {
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        *renderMode = RenderMode::Mesh;
+    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        *renderMode = RenderMode::Impostor;
+}
+
+// F3 toggles the latency overlay. 'keyHeld' remembers the key state, so holding it toggles only once
+void processOverlayInput(GLFWwindow *window, bool* showOverlay, bool* keyHeld) {
+    bool pressed = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+    if (pressed && !*keyHeld)
+        *showOverlay = !*showOverlay;
+    *keyHeld = pressed;
+}
+
 // Mouse orienting callback
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     // Retrieve the user pointer
@@ -276,21 +276,73 @@ int main() {
         return -1;
     }
 
-    std::vector<Sphere> spheres = {
-        Sphere(glm::vec3{0,0,0}, glm::vec3{0,0,0}, 0.3f, 7.35E17)
+    // GRAVITY_ALLOCATION_SAMPLING=N records the call site of every Nth allocation, printed on exit
+    const char* samplingInterval = std::getenv("GRAVITY_ALLOCATION_SAMPLING");
+    if (samplingInterval) setAllocationSampling(std::atoi(samplingInterval));
+    // GRAVITY_PERF_COUNTERS=1 counts cycles, instructions and misses per phase, printed on exit
+    perfCountersInit();
+
+    // GRAVITY_CHECKPOINT=file resumes from that checkpoint if it exists, and saves one there
+    // every CHECKPOINT_INTERVAL steps and on exit
+    const char* checkpointPath = std::getenv("GRAVITY_CHECKPOINT");
+    SimulationState initialState;
+    if (checkpointPath && std::ifstream(checkpointPath).good()) {
+        if (!readCheckpoint(checkpointPath, initialState)) {
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "Resuming from step " << initialState.clock.step << " of " << checkpointPath << "\n";
+    } else {
+        initialState.spheres = {
+            Sphere(glm::vec3{0,0,0}, glm::vec3{0,0,0}, 0.3f, 7.35E17)
+        };
+    }
+    const std::vector<Sphere> &spheres = initialState.spheres;
+
+    // All program variants are created in one batch: cached binaries are loaded from disk,
+    // the others compile in parallel on the driver's threads
+    auto shaderStart = std::chrono::high_resolution_clock::now();
+    initParallelShaderCompile((GLADloadproc)glfwGetProcAddress);
+
+    ShaderProgram shaderProgram;
+    ShaderProgram impostorProgram;
+    ShaderProgram overlayProgram;
+    ShaderProgram* programs[] = {&shaderProgram, &impostorProgram, &overlayProgram};
+    const ShaderProgramSource programSources[] = {
+        {"vertex_shader.glsl", "fragment_shader.glsl"},
+        {"impostor_vertex.glsl", "impostor_fragment.glsl"},
+        {"overlay_vertex.glsl", "overlay_fragment.glsl"},
     };
-
-    int shaderProgram = createShaderProgram("vertex_shader.glsl", "fragment_shader.glsl");
-
-    int sectorCount = 18;
-    int stackCount = 9;
-    std::vector<unsigned int> sphereIndices;
-    std::vector<unsigned int> sphereLineIndices;
-
-    std::vector<float> sphereVertices = generateSphereVertices(stackCount, sectorCount);
-    generateSphereIndices(stackCount, sectorCount, sphereIndices, sphereLineIndices);
-
-    initVAOVBO(sphereVertices, sphereIndices, sphereLineIndices);
+    if (!ShaderProgram::createAll(programs, programSources, 3)) {
+        glfwTerminate();
+        return -1;
+    }
+    std::chrono::duration<float, std::milli> shaderTime = std::chrono::high_resolution_clock::now() - shaderStart;
+    std::cout << "Shader programs ready in " << shaderTime.count() << " ms\n";
+    shaderProgram.bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+    impostorProgram.bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+    RenderMode renderMode = RenderMode::Mesh;
+
+    // Every LOD level shares one VBO/EBO pair. The meshes themselves are built at compile time
+    SphereMeshCache sphereMeshes = buildSphereMeshCache();
+
+    initVAOVBO(sphereMeshes);
+    initImpostorVAO();
+
+    std::vector<unsigned char> sphereLod; // Per-sphere LOD level, rebuilt every frame
+    sphereLod.reserve(spheres.size());
+    unsigned int lodFirst[SPHERE_LOD_COUNT];
+    unsigned int lodCount[SPHERE_LOD_COUNT];
+
+    // Instance data is written straight into persistently mapped memory, one region per frame in flight
+    StreamBuffer instanceStream;
+    // The frame block is streamed the same way, so updating it never waits on the GPU
+    StreamBuffer frameStream;
+    if (!instanceStream.create(GL_ARRAY_BUFFER, spheres.size() * sizeof(InstanceData)) ||
+        !frameStream.create(GL_UNIFORM_BUFFER, sizeof(FrameBlock))) {
+        glfwTerminate();
+        return -1;
+    }
 
     // Create a camera and set the window's user pointer to this.
     // Is done since 'glfwSetCursorPosCallback' signature limits argument list to this callback only.
@@ -300,95 +352,243 @@ int main() {
     glm::mat4 view = glm::lookAt(camera.pos, camera.pos + camera.front, camera.up);
     glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 0.1f, 100.0f);
 
-    // Get view location in a shader program
-    int projLoc = glGetUniformLocation(shaderProgram, "projection");
-    int viewLoc = glGetUniformLocation(shaderProgram, "view");
-
-    auto lastTime = std::chrono::high_resolution_clock::now();
-    auto currentTime = lastTime;
-
     // Bind callback
     glfwSetCursorPosCallback(window, mouse_callback);
 
-    glUseProgram(shaderProgram);
+    // Impostors write gl_FragDepth, and overlapping spheres need sorting either way
+    glEnable(GL_DEPTH_TEST);
 
-    while (!glfwWindowShouldClose(window)) {
-        currentTime = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<float> dt = currentTime - lastTime;
-        lastTime = currentTime;
+    // GPU time per pass, read back a few frames late so it never stalls
+    GpuProfiler gpuProfiler;
+    gpuProfiler.create();
+
+    // Tail latencies: CPU time per frame, and time between consecutive presents (what the user sees)
+    LatencyHistogram frameTimes;
+    LatencyHistogram presentIntervals;
+    std::chrono::steady_clock::time_point lastPresent;
+    bool presented = false;
 
+    // Latency overlay, toggled with F3
+    TextOverlay overlay;
+    if (!overlay.create(overlayProgram)) {
+        glfwTerminate();
+        return -1;
+    }
+    bool showOverlay = false;
+    bool overlayKeyHeld = false;
+
+    // Simulation runs on its own thread from here on; the render loop only reads snapshots
+    PhysicsThread physics;
+    // Solver, threads and grain are tuned by timing trials at startup and every minute;
+    // GRAVITY_AUTOTUNE=0 keeps the exact direct sum on every thread
+    const char* autotune = std::getenv("GRAVITY_AUTOTUNE");
+    if (!autotune || std::strcmp(autotune, "0") != 0) physics.setAutotune("default");
+    // GRAVITY_DETERMINISTIC=1 steps bit-identically on every run, e.g. to replay a bug report
+    const char* deterministic = std::getenv("GRAVITY_DETERMINISTIC");
+    physics.setDeterministic(deterministic && std::strcmp(deterministic, "1") == 0);
+    if (checkpointPath) physics.setCheckpoints(checkpointPath, CHECKPOINT_INTERVAL);
+    // GRAVITY_TRAJECTORY=file streams positions to a trajectory file, or every field with
+    // GRAVITY_TRAJECTORY_FIELDS=full. GRAVITY_TRAJECTORY_COMPRESSION=lossless compresses it, =lossy keeps
+    // positions only to within GRAVITY_TRAJECTORY_TOLERANCE (world units, 1e-4 by default). How far that
+    // compresses depends on how far motion bends between frames: a frame every TRAJECTORY_INTERVAL steps
+    // comes out about 4x smaller at 1e-4 and 6.5x at 1e-3, and reaches the 10-30x range at 1e-2 (about 13x)
+    TrajectoryWriter trajectory;
+    const char* trajectoryPath = std::getenv("GRAVITY_TRAJECTORY");
+    if (trajectoryPath) {
+        const char* fields = std::getenv("GRAVITY_TRAJECTORY_FIELDS");
+        const char* compression = std::getenv("GRAVITY_TRAJECTORY_COMPRESSION");
+        TrajectoryOptions options;
+        options.fields = fields && std::strcmp(fields, "full") == 0 ? TRAJECTORY_FULL_STATE : TRAJECTORY_POSITIONS_ONLY;
+        if (compression && std::strcmp(compression, "lossless") == 0) options.compression = TRAJECTORY_LOSSLESS;
+        if (compression && std::strcmp(compression, "lossy") == 0) options.compression = TRAJECTORY_LOSSY;
+        const char* tolerance = std::getenv("GRAVITY_TRAJECTORY_TOLERANCE");
+        if (tolerance) options.tolerance = std::strtof(tolerance, nullptr);
+        options.compressionThreads = TRAJECTORY_COMPRESSION_THREADS;
+        if (trajectory.open(trajectoryPath, spheres.size(), options)) {
+            physics.setTrajectory(&trajectory, TRAJECTORY_INTERVAL);
+        }
+    }
+    physics.start(std::move(initialState));
+
+    // Steady-state frames must not allocate; every phase is checked separately
+    AllocationPhases allocationPhases;
+    uint64_t frameIndex = 0;
+    unsigned int allocationReports = 0;
+
+    PROFILE_THREAD("render");
+    while (!glfwWindowShouldClose(window)) {
+        PROFILE_ZONE("frame");
+        auto frameStart = std::chrono::steady_clock::now();
+        allocationPhases.begin();
+        gpuProfiler.beginFrame();
+
+        // Latest complete physics state. Keeps the previous one if no step finished since last frame
+        PROFILE_BEGIN("snapshot");
+        physics.snapshots().acquire();
+        const PhysicsSnapshot &snapshot = physics.snapshots().readBuffer();
+        allocationPhases.mark("snapshot");
+        PROFILE_END();
+
+        PROFILE_BEGIN("uniforms");
         processInput(window, &camera);
+        processRenderModeInput(window, &renderMode);
+        processOverlayInput(window, &showOverlay, &overlayKeyHeld);
 
         // Update transformation matrix
         view = glm::lookAt(camera.pos, camera.pos + camera.front, camera.up);
         projection = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 0.1f, 100.0f);
-        // Send it to shader
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
+        // Send it to shader: one uniform buffer write per frame, shared by every program
+        FrameBlock* frameBlock = static_cast<FrameBlock*>(frameStream.map());
+        frameBlock->view = view;
+        frameBlock->projection = projection;
+        // Bodies are blended between the last two physics steps on the GPU; the CPU only sends this factor
+        frameBlock->interpolation = snapshot.interpolation(physicsClock());
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameStream.id(), frameStream.offset(), sizeof(FrameBlock));
+
+        if (renderMode == RenderMode::Mesh)
+            shaderProgram.use();
+        else
+            impostorProgram.use();
+        allocationPhases.mark("uniforms");
+        PROFILE_END();
+
+        PROFILE_BEGIN("instances");
+        gpuProfiler.begin("clear");
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        for (auto &circle : spheres)
-        {
-            // Transformation matrix
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, circle.pos);
-
-            // Upload uniforms
-            int modelLoc = glGetUniformLocation(shaderProgram, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-            int radiusLoc = glGetUniformLocation(shaderProgram, "radius");
-            glUniform1f(radiusLoc, circle.radius); // Send radius to shader
-
-            circle.acc = glm::vec3(0.f);
-
-            for (auto &circle2 : spheres) {
-                if (&circle == &circle2) continue;
-
-                glm::vec3 dr = circle2.pos - circle.pos;
-                float dist = glm::length(dr);
-                
-                if (dist < circle.radius + circle2.radius) {
-                    float overlap = circle.radius + circle2.radius - dist;
-                    glm::vec3 correction = dr/dist * (overlap * 0.5f);
-
-                    circle.pos = circle.pos - correction;
-                    circle2.pos = circle2.pos + correction;
-                }
-                else {
-                    glm::vec3 direction = dr / dist;
-                    glm::vec3 Gforce = direction * (G * circle.mass * circle2.mass) / (powf(10,9)*dist*dist);
-                    circle.applyForce(Gforce);
-                }
-            }
-
-            circle.updatePos(dt.count());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gpuProfiler.end();
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        float pixelsPerUnit = projection[1][1] * framebufferHeight * 0.5f; // Screen pixels per world unit at depth 1
+        Frustum frustum = extractFrustum(projection * view);
+        size_t instanceCount = 0;
+        // Blocks only if the GPU is still reading this region from three frames ago. A failed reserve has
+        // already freed the old storage, so nothing may be written: draw no bodies and quit
+        if (instanceStream.reserve(snapshot.bodies.size() * sizeof(InstanceData))) {
+            InstanceData* instances = static_cast<InstanceData*>(instanceStream.map());
+            instanceCount = writeVisibleInstances(snapshot.bodies, frustum, view, pixelsPerUnit, sphereLod, instances, lodFirst, lodCount);
+        } else {
+            for (unsigned int level = 0; level < SPHERE_LOD_COUNT; level++) lodCount[level] = 0;
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+        allocationPhases.mark("instances");
+        PROFILE_END();
 
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, sphereVertices.size() * sizeof(float), sphereVertices.data());
+        PROFILE_BEGIN("draw");
+        gpuProfiler.begin("spheres");
 
-            // Draw sphere (wireframe). Bind VAO first
+        // Draw every sphere: one instanced call per LOD level. Bind VAO first
+        if (renderMode == RenderMode::Mesh) {
+            PerfScope submitCounters(PERF_RENDER_SUBMIT, instanceCount);
             glBindVertexArray(VAO);
+            glBindVertexBuffer(INSTANCE_BINDING, instanceStream.id(), instanceStream.offset(), sizeof(InstanceData));
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, (void*)0);
-            //glDrawElements(GL_LINES, sphereLineIndices.size(), GL_UNSIGNED_INT, (void*)0);
+            for (unsigned int level = 0; level < SPHERE_LOD_COUNT; level++) {
+                if (lodCount[level] == 0) continue;
+                const SphereLod &lod = sphereMeshes.lods[level];
+                // baseVertex selects the level's vertices, baseInstance its range in the instance region
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_SHORT,
+                    (void*)(lod.firstIndex * sizeof(uint16_t)), lodCount[level], lod.baseVertex, lodFirst[level]);
+                //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_LINES);
+                //glDrawElementsInstancedBaseVertexBaseInstance(GL_LINES, lod.lineIndexCount, GL_UNSIGNED_SHORT,
+                //    (void*)(lod.firstLineIndex * sizeof(uint16_t)), lodCount[level], lod.baseVertex, lodFirst[level]);
+            }
+        } else {
+            // Impostors ignore LOD; the buckets are contiguous, so draw them all at once
+            // 4 vertices per body, corners generated from gl_VertexID
+            PerfScope submitCounters(PERF_RENDER_SUBMIT, instanceCount);
+            glBindVertexArray(IMPOSTOR_VAO);
+            glBindVertexBuffer(INSTANCE_BINDING, instanceStream.id(), instanceStream.offset(), sizeof(InstanceData));
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+        }
 
-            // unbind VAO
-            glBindVertexArray(0);
+        // unbind VAO
+        glBindVertexArray(0);
+        gpuProfiler.end();
+
+        if (showOverlay) {
+            gpuProfiler.begin("overlay");
+            // Percentiles scan every bucket, so the text is only rebuilt every few frames
+            if (frameIndex % OVERLAY_REFRESH_FRAMES == 0) {
+                char line[160];
+                overlay.clear();
+                formatLatencyLine(line, sizeof(line), "Frame", frameTimes);
+                overlay.print(10, 10, line);
+                formatLatencyLine(line, sizeof(line), "Present", presentIntervals);
+                overlay.print(10, 10 + overlay.lineHeight(), line);
+                formatLatencyLine(line, sizeof(line), "Sim step", physics.stepTimes());
+                overlay.print(10, 10 + 2 * overlay.lineHeight(), line);
+                snprintf(line, sizeof(line), "GPU: %.2f ms", gpuProfiler.lastFrameMilliseconds());
+                overlay.print(10, 10 + 3 * overlay.lineHeight(), line);
+            }
+            overlay.draw(framebufferWidth, framebufferHeight);
+            gpuProfiler.end();
         }
+        gpuProfiler.endFrame();
+
+        // The regions may be reused once the GPU has passed this point
+        instanceStream.unmap();
+        frameStream.unmap();
+        allocationPhases.mark("draw");
+        PROFILE_END();
         
+        frameTimes.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - frameStart).count());
+        PROFILE_BEGIN("swap");
         glfwSwapBuffers(window);
+        PROFILE_END();
+        auto present = std::chrono::steady_clock::now();
+        if (presented) presentIntervals.record(std::chrono::duration_cast<std::chrono::nanoseconds>(present - lastPresent).count());
+        lastPresent = present;
+        presented = true;
+        PROFILE_BEGIN("events");
         glfwPollEvents(); // IO events
+        PROFILE_END();
+        allocationPhases.mark("present");
+
+        if (++frameIndex > ALLOCATION_WARMUP_FRAMES && allocationPhases.total().allocations > 0 &&
+            allocationReports < MAX_ALLOCATION_REPORTS) {
+            std::cerr << "Frame " << frameIndex << " allocated: ";
+            allocationPhases.print(std::cerr);
+            std::cerr << (++allocationReports == MAX_ALLOCATION_REPORTS ? ", not reporting further frames\n" : "\n");
+        }
     }
 
     // Cleanup
+    physics.stop();
+    if (checkpointPath && physics.saveCheckpoint(checkpointPath)) std::cout << "Checkpoint written to " << checkpointPath << "\n";
+    if (trajectory.isOpen()) {
+        uint64_t stalls = trajectory.stalls();
+        if (trajectory.close()) std::cout << "Trajectory written to " << trajectoryPath << ", stepping waited on it " << stalls << " times\n";
+    }
+    printLatencyReport(std::cout, "Frame time", frameTimes);
+    printLatencyReport(std::cout, "Present interval", presentIntervals);
+    printLatencyReport(std::cout, "Sim step", physics.stepTimes());
+    printPerfReport(std::cout);
     glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &IMPOSTOR_VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &EBO_LINES);
+    instanceStream.destroy();
+    frameStream.destroy();
+    if (gpuProfiler.framesMeasured() > 0) {
+        std::cout << "GPU frame time: average " << gpuProfiler.averageFrameMilliseconds() << " ms, max "
+                  << gpuProfiler.maxFrameMilliseconds() << " ms over " << gpuProfiler.framesMeasured() << " frames ("
+                  << gpuProfiler.framesDropped() << " not ready in time)\n";
+    }
+    gpuProfiler.destroy();
+    overlay.destroy();
+    shaderProgram.destroy();
+    impostorProgram.destroy();
+    overlayProgram.destroy();
     
     glfwDestroyWindow(window);
     glfwTerminate();
 
+    if (samplingInterval) printAllocationSamples(std::cout);
+#ifdef GRAVITY_PROFILER
+    if (profilerWriteTrace(PROFILE_TRACE_PATH)) std::cout << "Trace written to " << PROFILE_TRACE_PATH << "\n";
+#endif
     return 0;
 }
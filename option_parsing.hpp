@@ -0,0 +1,40 @@
+#ifndef OPTION_PARSING_HPP
+#define OPTION_PARSING_HPP
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Command line helpers shared by the headless study tools
+
+// Comma-separated positive integers, e.g. "1000,4000"
+template <typename T>
+bool parseNumberList(const char* text, std::vector<T>& values) {
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end;
+        unsigned long long value = std::strtoull(item.c_str(), &end, 10);
+        if (item.empty() || *end || value == 0) return false;
+        values.push_back(T(value));
+    }
+    return !values.empty();
+}
+
+// Comma-separated numbers with fractions, e.g. "0.3,0.5"
+inline bool parseRealList(const char* text, std::vector<double>& values) {
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end;
+        double value = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end) return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+#endif
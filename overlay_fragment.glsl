@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 texCoord;
+
+uniform sampler2D atlas; // One channel, 1 where a glyph pixel is set
+
+out vec4 FragColor;
+
+void main() {
+    if (texture(atlas, texCoord).r < 0.5) discard;
+    FragColor = vec4(1.0, 1.0, 0.7, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+// Overlay text: one screen-aligned quad per glyph, expanded from gl_VertexID.
+// Draw with GL_TRIANGLE_STRIP, 4 vertices, one instance per glyph.
+layout(location=0) in vec2 aPosition; // Per-instance: top-left corner in pixels from the top-left of the window
+layout(location=1) in uint aGlyph; // Per-instance: cell index in the glyph atlas
+
+uniform vec2 screenSize; // Framebuffer size in pixels
+
+const vec2 CELL_SIZE = vec2(6.0, 8.0); // Atlas cell in font pixels
+const float GLYPH_SCALE = 2.0; // Screen pixels per font pixel, see TextOverlay::GLYPH_SCALE
+const uint ATLAS_COLUMNS = 16u;
+const vec2 ATLAS_CELLS = vec2(16.0, 4.0);
+
+out vec2 texCoord;
+
+void main() {
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+    vec2 pixel = aPosition + corner * CELL_SIZE * GLYPH_SCALE;
+    // Pixels (y down) to clip space (y up)
+    gl_Position = vec4(pixel.x / screenSize.x * 2.0 - 1.0, 1.0 - pixel.y / screenSize.y * 2.0, 0.0, 1.0);
+
+    vec2 cell = vec2(float(aGlyph % ATLAS_COLUMNS), float(aGlyph / ATLAS_COLUMNS));
+    texCoord = (cell + corner) / ATLAS_CELLS;
+}
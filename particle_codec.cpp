@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "particle_codec.hpp"
+
+// Plane bytes per independently coded segment, the unit of parallel work
+static const size_t SEGMENT_BYTES = 256 * 1024;
+
+// rANS with 32-bit state and byte-wise renormalization; frequencies sum to 1 << RANS_SCALE_BITS
+static const uint32_t RANS_SCALE_BITS = 12;
+static const uint32_t RANS_SCALE = 1u << RANS_SCALE_BITS;
+static const uint32_t RANS_LOW = 1u << 23;
+
+// Bodies per lossy tile. A tile over all frames of a chunk stays in cache while it is quantized
+static const size_t TILE_BODIES = 1024;
+
+enum PlaneMode : uint32_t {
+    PLANE_ZERO = 0, // Every byte is zero; nothing stored
+    PLANE_RAW = 1, // Stored as is, when entropy coding would not pay off
+    PLANE_RANS = 2, // One rANS state; still decoded, no longer written
+    PLANE_RANS_INTERLEAVED = 3, // Two rANS states taking turns, so the work of one overlaps the other
+};
+
+struct PlaneHeader {
+    uint32_t mode; // PlaneMode
+    uint32_t segmentCount;
+};
+
+// Precedes the planes of lossy data, followed by the origin of every tile and component
+struct LossyHeader {
+    double step; // Quantization step, twice the tolerance
+    uint32_t components;
+    uint32_t tileCount;
+};
+
+// Encoder constants of one byte value. The division by the frequency is a multiplication by its
+// reciprocal and a shift, which is what makes encoding fast
+struct RansSymbol {
+    uint32_t limit; // Renormalize while the state is at least this
+    uint32_t reciprocal;
+    uint32_t bias;
+    uint32_t complement; // RANS_SCALE - frequency
+    uint32_t shift;
+};
+
+static RansSymbol ransSymbol(uint32_t start, uint32_t frequency) {
+    RansSymbol symbol;
+    symbol.limit = ((RANS_LOW >> RANS_SCALE_BITS) << 8) * frequency;
+    symbol.complement = RANS_SCALE - frequency;
+    if (frequency < 2) {
+        // x / 1 = x: with an all-ones reciprocal the quotient comes out as x - 1, which the bias makes up for
+        symbol.reciprocal = ~0u;
+        symbol.shift = 0;
+        symbol.bias = start + RANS_SCALE - 1;
+    } else {
+        uint32_t shift = 0;
+        while (frequency > (1u << shift)) shift++;
+        symbol.reciprocal = uint32_t(((1ull << (shift + 31)) + frequency - 1) / frequency);
+        symbol.shift = shift - 1;
+        symbol.bias = start;
+    }
+    return symbol;
+}
+
+// Shared by the parallel passes of encodeWords
+struct PlaneJob {
+    const uint32_t* residuals;
+    unsigned char* planes;
+    size_t count; // Words, i.e. bytes per plane
+    size_t segmentsPerPlane;
+    unsigned int activePlanes; // Planes above these are zero throughout and skipped
+    std::atomic<uint32_t> usedBits; // Or of all residuals
+    uint32_t* histograms; // 256 byte counts per segment of every plane
+    const RansSymbol (*symbols)[256]; // Per plane
+    const PlaneMode* modes;
+    std::vector<std::vector<unsigned char>>* segments;
+};
+
+struct PredictJob {
+    const uint32_t* words;
+    uint32_t* residuals;
+    size_t frameWords;
+};
+
+// Word i predicted from the same word of earlier frames, as integers: the value of the previous frame
+// extrapolated along the step from the one before. Exact integer arithmetic, so decoding repeats it bit for bit
+static uint32_t predict(const uint32_t* words, size_t i, size_t frameWords) {
+    if (i < frameWords) return 0;
+    if (i < 2 * frameWords) return words[i - frameWords];
+    return 2 * words[i - frameWords] - words[i - 2 * frameWords];
+}
+
+// Small differences of either sign become small unsigned numbers: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+static uint32_t zigzag(uint32_t difference) {
+    return (difference << 1) ^ uint32_t(int32_t(difference) >> 31);
+}
+
+static uint32_t unzigzag(uint32_t residual) {
+    return (residual >> 1) ^ (0u - (residual & 1));
+}
+
+static void predictRange(void* context, size_t begin, size_t end) {
+    const PredictJob &job = *static_cast<PredictJob*>(context);
+    for (size_t i = begin; i < end; i++) job.residuals[i] = zigzag(job.words[i] - predict(job.words, i, job.frameWords));
+}
+
+struct QuantizeJob {
+    const float* values;
+    uint32_t* quantized;
+    uint32_t* residuals;
+    float* origins;
+    size_t frameCount;
+    size_t frameWords;
+    size_t tileWords; // TILE_BODIES * components
+    unsigned int components;
+    double inverseStep;
+    std::atomic<bool> failed;
+};
+
+// Quantize whole tiles over every frame, and predict the counts right away while the tile is in cache
+static void quantizeRange(void* context, size_t begin, size_t end) {
+    QuantizeJob &job = *static_cast<QuantizeJob*>(context);
+    for (size_t tile = begin; tile < end; tile++) {
+        size_t first = tile * job.tileWords;
+        size_t last = std::min(job.frameWords, first + job.tileWords);
+        float* origin = job.origins + tile * job.components;
+        for (unsigned int c = 0; c < job.components; c++) origin[c] = std::numeric_limits<float>::infinity();
+        for (size_t frame = 0; frame < job.frameCount; frame++) {
+            const float* values = job.values + frame * job.frameWords;
+            for (size_t i = first; i < last; i += job.components) {
+                for (unsigned int c = 0; c < job.components; c++) origin[c] = std::min(origin[c], values[i + c]);
+            }
+        }
+        for (size_t frame = 0; frame < job.frameCount; frame++) {
+            size_t base = frame * job.frameWords;
+            for (size_t i = base + first; i < base + last; i += job.components) {
+                for (unsigned int c = 0; c < job.components; c++) {
+                    // Also false for NaN and infinities, and for an origin that is not finite
+                    double steps = (double(job.values[i + c]) - origin[c]) * job.inverseStep + 0.5;
+                    if (!(steps < 4294967296.0)) {
+                        job.failed = true;
+                        return;
+                    }
+                    job.quantized[i + c] = uint32_t(steps);
+                    job.residuals[i + c] = zigzag(job.quantized[i + c] - predict(job.quantized, i + c, job.frameWords));
+                }
+            }
+        }
+    }
+}
+
+static void usedBitsRange(void* context, size_t begin, size_t end) {
+    PlaneJob &job = *static_cast<PlaneJob*>(context);
+    uint32_t bits = 0;
+    for (size_t i = begin; i < end; i++) bits |= job.residuals[i];
+    job.usedBits.fetch_or(bits, std::memory_order_relaxed);
+}
+
+static void shuffleRange(void* context, size_t begin, size_t end) {
+    const PlaneJob &job = *static_cast<PlaneJob*>(context);
+    for (unsigned int plane = 0; plane < job.activePlanes; plane++) {
+        unsigned char* bytes = job.planes + plane * job.count;
+        for (size_t i = begin; i < end; i++) bytes[i] = (unsigned char)(job.residuals[i] >> (8 * plane));
+    }
+}
+
+// First and one past the last byte of segment 'index' (over all planes) within the planes buffer
+static void segmentBounds(const PlaneJob& job, size_t index, size_t& begin, size_t& end) {
+    size_t plane = index / job.segmentsPerPlane;
+    size_t segment = index % job.segmentsPerPlane;
+    begin = plane * job.count + segment * SEGMENT_BYTES;
+    end = plane * job.count + std::min(job.count, (segment + 1) * SEGMENT_BYTES);
+}
+
+static void histogramRange(void* context, size_t begin, size_t end) {
+    const PlaneJob &job = *static_cast<PlaneJob*>(context);
+    for (size_t index = begin; index < end; index++) {
+        if (index / job.segmentsPerPlane >= job.activePlanes) continue;
+        // Four tables, so runs of one byte value do not wait on the previous increment of the same counter
+        uint32_t partial[4][256] = {};
+        size_t first, last;
+        segmentBounds(job, index, first, last);
+        size_t i = first;
+        for (; i + 4 <= last; i += 4) {
+            partial[0][job.planes[i]]++;
+            partial[1][job.planes[i + 1]]++;
+            partial[2][job.planes[i + 2]]++;
+            partial[3][job.planes[i + 3]]++;
+        }
+        for (; i < last; i++) partial[0][job.planes[i]]++;
+        uint32_t* counts = job.histograms + index * 256;
+        for (unsigned int s = 0; s < 256; s++) counts[s] = partial[0][s] + partial[1][s] + partial[2][s] + partial[3][s];
+    }
+}
+
+static inline void ransEncode(uint32_t& state, unsigned char*& head, const RansSymbol& symbol) {
+    while (state >= symbol.limit) {
+        *--head = (unsigned char)state;
+        state >>= 8;
+    }
+    // state = (state / frequency) * RANS_SCALE + state % frequency + start
+    uint32_t quotient = uint32_t((uint64_t(state) * symbol.reciprocal) >> 32) >> symbol.shift;
+    state += symbol.bias + quotient * symbol.complement;
+}
+
+static inline void ransFlush(uint32_t state, unsigned char*& head) {
+    head -= 4;
+    for (unsigned int b = 0; b < 4; b++) head[b] = (unsigned char)(state >> (8 * b));
+}
+
+static void ransEncodeRange(void* context, size_t begin, size_t end) {
+    const PlaneJob &job = *static_cast<PlaneJob*>(context);
+    for (size_t index = begin; index < end; index++) {
+        size_t plane = index / job.segmentsPerPlane;
+        if (job.modes[plane] != PLANE_RANS_INTERLEAVED) continue;
+        const RansSymbol* symbols = job.symbols[plane];
+        const unsigned char* bytes = job.planes;
+        size_t first, last;
+        segmentBounds(job, index, first, last);
+
+        // Worst case 12 bits per byte, plus the final states. Written back to front, so the decoder
+        // reads forward: byte first + k goes to state k % 2
+        std::vector<unsigned char> &out = (*job.segments)[index];
+        out.resize((last - first) * 2 + 16);
+        unsigned char* head = out.data() + out.size();
+        uint32_t state0 = RANS_LOW;
+        uint32_t state1 = RANS_LOW;
+        size_t i = last;
+        if ((last - first) % 2 != 0) ransEncode(state0, head, symbols[bytes[--i]]);
+        for (; i > first; i -= 2) {
+            ransEncode(state1, head, symbols[bytes[i - 1]]);
+            ransEncode(state0, head, symbols[bytes[i - 2]]);
+        }
+        ransFlush(state1, head);
+        ransFlush(state0, head);
+        size_t size = out.data() + out.size() - head;
+        std::memmove(out.data(), head, size);
+        out.resize(size);
+    }
+}
+
+// Scale byte counts to frequencies summing to RANS_SCALE; every byte that occurs keeps at least 1
+static void normalizeFrequencies(const uint64_t* counts, uint64_t total, uint32_t* frequencies) {
+    uint32_t sum = 0;
+    unsigned int largest = 0;
+    for (unsigned int s = 0; s < 256; s++) {
+        frequencies[s] = counts[s] ? std::max<uint32_t>(1, uint32_t(counts[s] * RANS_SCALE / total)) : 0;
+        sum += frequencies[s];
+        if (counts[s] > counts[largest]) largest = s;
+    }
+    if (sum < RANS_SCALE) frequencies[largest] += RANS_SCALE - sum;
+    while (sum > RANS_SCALE) {
+        // Rare symbols rounded up to 1 overshot; take it back from the most frequent ones
+        unsigned int top = 0;
+        for (unsigned int s = 1; s < 256; s++) {
+            if (frequencies[s] > frequencies[top]) top = s;
+        }
+        frequencies[top]--;
+        sum--;
+    }
+}
+
+static void append(std::vector<unsigned char>& out, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+void ParticleCodec::encodeLossless(const uint32_t* words, size_t frameCount, size_t frameWords, std::vector<unsigned char>& out,
+                                   WorkerPool& pool) {
+    size_t count = frameCount * frameWords;
+    residuals.resize(count);
+    PredictJob job = {words, residuals.data(), frameWords};
+    pool.parallelFor(count, 64 * 1024, predictRange, &job);
+    encodeWords(count, out, pool);
+}
+
+void ParticleCodec::encodeWords(size_t count, std::vector<unsigned char>& out, WorkerPool& pool) {
+    planes.resize(4 * count);
+    size_t segmentsPerPlane = (count + SEGMENT_BYTES - 1) / SEGMENT_BYTES;
+    size_t segmentCount = 4 * segmentsPerPlane;
+    histograms.resize(segmentCount * 256);
+    uint32_t frequencies[4][256];
+    RansSymbol symbols[4][256];
+    PlaneMode modes[4];
+    if (segments.size() < segmentCount) segments.resize(segmentCount);
+
+    PlaneJob job;
+    job.residuals = residuals.data();
+    job.planes = planes.data();
+    job.count = count;
+    job.segmentsPerPlane = segmentsPerPlane;
+    job.usedBits = 0;
+    job.histograms = histograms.data();
+    job.symbols = symbols;
+    job.modes = modes;
+    job.segments = &segments;
+    // Predicted data rarely needs all four bytes; the unused planes are neither split out nor counted
+    pool.parallelFor(count, 64 * 1024, usedBitsRange, &job);
+    job.activePlanes = 0;
+    while (job.activePlanes < 4 && job.usedBits >> (8 * job.activePlanes) != 0) job.activePlanes++;
+    pool.parallelFor(count, 64 * 1024, shuffleRange, &job);
+    pool.parallelFor(segmentCount, 1, histogramRange, &job);
+
+    // Pick a mode per plane from its histogram: rANS when the order-0 entropy promises a real saving
+    for (unsigned int plane = 0; plane < 4; plane++) {
+        if (plane >= job.activePlanes) {
+            modes[plane] = PLANE_ZERO;
+            continue;
+        }
+        uint64_t counts[256] = {};
+        for (size_t segment = 0; segment < segmentsPerPlane; segment++) {
+            const uint32_t* segmentCounts = histograms.data() + (plane * segmentsPerPlane + segment) * 256;
+            for (unsigned int s = 0; s < 256; s++) counts[s] += segmentCounts[s];
+        }
+        if (count == 0 || counts[0] == count) {
+            modes[plane] = PLANE_ZERO;
+            continue;
+        }
+        double bits = 0.0;
+        for (unsigned int s = 0; s < 256; s++) {
+            if (counts[s]) bits += counts[s] * std::log2(double(count) / counts[s]);
+        }
+        double overhead = sizeof(uint16_t) * 256 + sizeof(uint32_t) * segmentsPerPlane;
+        modes[plane] = bits / 8 + overhead < 0.97 * count ? PLANE_RANS_INTERLEAVED : PLANE_RAW;
+        if (modes[plane] != PLANE_RANS_INTERLEAVED) continue;
+        normalizeFrequencies(counts, count, frequencies[plane]);
+        uint32_t start = 0;
+        for (unsigned int s = 0; s < 256; s++) {
+            symbols[plane][s] = ransSymbol(start, frequencies[plane][s]);
+            start += frequencies[plane][s];
+        }
+    }
+    pool.parallelFor(segmentCount, 1, ransEncodeRange, &job);
+
+    for (unsigned int plane = 0; plane < 4; plane++) {
+        const unsigned char* bytes = planes.data() + plane * count;
+        size_t encodedSize = 0;
+        for (size_t segment = 0; modes[plane] == PLANE_RANS_INTERLEAVED && segment < segmentsPerPlane; segment++) {
+            encodedSize += segments[plane * segmentsPerPlane + segment].size();
+        }
+        // The estimate can be off for tiny planes; never store more than the plane itself
+        if (modes[plane] == PLANE_RANS_INTERLEAVED && encodedSize + sizeof(uint16_t) * 256 + sizeof(uint32_t) * segmentsPerPlane >= count) {
+            modes[plane] = PLANE_RAW;
+        }
+
+        PlaneHeader header = {modes[plane], uint32_t(segmentsPerPlane)};
+        append(out, &header, sizeof(header));
+        if (modes[plane] == PLANE_RAW) append(out, bytes, count);
+        if (modes[plane] != PLANE_RANS_INTERLEAVED) continue;
+        for (unsigned int s = 0; s < 256; s++) {
+            uint16_t frequency = uint16_t(frequencies[plane][s]);
+            append(out, &frequency, sizeof(frequency));
+        }
+        for (size_t segment = 0; segment < segmentsPerPlane; segment++) {
+            uint32_t size = segments[plane * segmentsPerPlane + segment].size();
+            append(out, &size, sizeof(size));
+        }
+        for (size_t segment = 0; segment < segmentsPerPlane; segment++) {
+            const std::vector<unsigned char> &encoded = segments[plane * segmentsPerPlane + segment];
+            append(out, encoded.data(), encoded.size());
+        }
+    }
+}
+
+bool ParticleCodec::encodeLossy(const float* values, size_t frameCount, size_t frameWords, unsigned int components,
+                                float tolerance, std::vector<unsigned char>& out, WorkerPool& pool) {
+    if (components == 0 || frameWords % components != 0 || !(tolerance > 0.f) || !std::isfinite(tolerance)) return false;
+    size_t count = frameCount * frameWords;
+    size_t tileWords = TILE_BODIES * components;
+    size_t tileCount = (frameWords + tileWords - 1) / tileWords;
+    LossyHeader header = {2.0 * tolerance, components, uint32_t(tileCount)};
+    quantized.resize(count);
+    residuals.resize(count);
+    origins.resize(tileCount * components);
+
+    QuantizeJob job;
+    job.values = values;
+    job.quantized = quantized.data();
+    job.residuals = residuals.data();
+    job.origins = origins.data();
+    job.frameCount = frameCount;
+    job.frameWords = frameWords;
+    job.tileWords = tileWords;
+    job.components = components;
+    job.inverseStep = 1.0 / header.step;
+    job.failed = false;
+    pool.parallelFor(tileCount, 1, quantizeRange, &job);
+    if (job.failed) return false;
+
+    append(out, &header, sizeof(header));
+    append(out, origins.data(), origins.size() * sizeof(float));
+    encodeWords(count, out, pool);
+    return true;
+}
+
+bool ParticleCodec::decodeLossy(const unsigned char* data, size_t size, size_t frameCount, size_t frameWords, float* values) {
+    LossyHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.components == 0 || frameWords % header.components != 0 || !(header.step > 0.0)) return false;
+    size_t tileWords = TILE_BODIES * header.components;
+    size_t tileCount = (frameWords + tileWords - 1) / tileWords;
+    size_t originBytes = tileCount * header.components * sizeof(float);
+    if (header.tileCount != tileCount || size - sizeof(header) < originBytes) return false;
+    origins.resize(tileCount * header.components);
+    std::memcpy(origins.data(), data + sizeof(header), originBytes);
+
+    size_t count = frameCount * frameWords;
+    size_t headerBytes = sizeof(header) + originBytes;
+    if (!decodeWords(data + headerBytes, size - headerBytes, count)) return false;
+    quantized.resize(count);
+    for (size_t frame = 0; frame < frameCount; frame++) {
+        for (size_t tile = 0; tile < tileCount; tile++) {
+            const float* origin = origins.data() + tile * header.components;
+            size_t first = frame * frameWords + tile * tileWords;
+            size_t last = frame * frameWords + std::min(frameWords, (tile + 1) * tileWords);
+            for (size_t i = first; i < last; i += header.components) {
+                for (unsigned int c = 0; c < header.components; c++) {
+                    quantized[i + c] = predict(quantized.data(), i + c, frameWords) + unzigzag(residuals[i + c]);
+                    values[i + c] = float(origin[c] + quantized[i + c] * header.step);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool ParticleCodec::decodeLossless(const unsigned char* data, size_t size, size_t frameCount, size_t frameWords, uint32_t* words) {
+    size_t count = frameCount * frameWords;
+    if (!decodeWords(data, size, count)) return false;
+    for (size_t i = 0; i < count; i++) words[i] = predict(words, i, frameWords) + unzigzag(residuals[i]);
+    return true;
+}
+
+// Decoder tables of one plane
+struct RansTable {
+    uint32_t frequencies[256];
+    uint32_t starts[256];
+    unsigned char symbols[RANS_SCALE]; // Symbol of every slot
+};
+
+static inline bool ransDecode(uint32_t& state, const RansTable& table, const unsigned char*& in, const unsigned char* end,
+                              unsigned char& out) {
+    uint32_t slot = state & (RANS_SCALE - 1);
+    unsigned char symbol = table.symbols[slot];
+    out = symbol;
+    state = table.frequencies[symbol] * (state >> RANS_SCALE_BITS) + slot - table.starts[symbol];
+    while (state < RANS_LOW) {
+        if (in == end) return false;
+        state = state << 8 | *in++;
+    }
+    return true;
+}
+
+// 'count' bytes of one segment coded with 'WAYS' states taking turns. False if the data runs out
+template <unsigned int WAYS>
+static bool ransDecodeSegment(const RansTable& table, const unsigned char* in, const unsigned char* end, unsigned char* bytes,
+                              size_t count) {
+    if (size_t(end - in) < 4 * WAYS) return false;
+    uint32_t states[WAYS];
+    for (unsigned int w = 0; w < WAYS; w++, in += 4) states[w] = in[0] | in[1] << 8 | in[2] << 16 | uint32_t(in[3]) << 24;
+    size_t i = 0;
+    for (; i + WAYS <= count; i += WAYS) {
+        for (unsigned int w = 0; w < WAYS; w++) {
+            if (!ransDecode(states[w], table, in, end, bytes[i + w])) return false;
+        }
+    }
+    for (unsigned int w = 0; i < count; i++, w++) {
+        if (!ransDecode(states[w], table, in, end, bytes[i])) return false;
+    }
+    return true;
+}
+
+bool ParticleCodec::decodeWords(const unsigned char* data, size_t size, size_t count) {
+    planes.resize(4 * count);
+    RansTable table;
+    const unsigned char* end = data + size;
+    size_t segmentsPerPlane = (count + SEGMENT_BYTES - 1) / SEGMENT_BYTES;
+
+    for (unsigned int plane = 0; plane < 4; plane++) {
+        unsigned char* bytes = planes.data() + plane * count;
+        PlaneHeader header;
+        if (size_t(end - data) < sizeof(header)) return false;
+        std::memcpy(&header, data, sizeof(header));
+        data += sizeof(header);
+        if (header.mode == PLANE_ZERO) {
+            std::memset(bytes, 0, count);
+            continue;
+        }
+        if (header.mode == PLANE_RAW) {
+            if (size_t(end - data) < count) return false;
+            std::memcpy(bytes, data, count);
+            data += count;
+            continue;
+        }
+        bool interleaved = header.mode == PLANE_RANS_INTERLEAVED;
+        if ((header.mode != PLANE_RANS && !interleaved) || header.segmentCount != segmentsPerPlane ||
+            size_t(end - data) < sizeof(uint16_t) * 256 + sizeof(uint32_t) * segmentsPerPlane) {
+            return false;
+        }
+
+        uint32_t start = 0;
+        for (unsigned int s = 0; s < 256; s++) {
+            uint16_t frequency;
+            std::memcpy(&frequency, data + s * sizeof(frequency), sizeof(frequency));
+            table.frequencies[s] = frequency;
+            table.starts[s] = start;
+            if (start + frequency > RANS_SCALE) return false;
+            std::memset(table.symbols + start, s, frequency);
+            start += frequency;
+        }
+        if (start != RANS_SCALE) return false;
+        const unsigned char* sizes = data + sizeof(uint16_t) * 256;
+        data = sizes + sizeof(uint32_t) * segmentsPerPlane;
+
+        for (size_t segment = 0; segment < segmentsPerPlane; segment++) {
+            uint32_t segmentSize;
+            std::memcpy(&segmentSize, sizes + segment * sizeof(segmentSize), sizeof(segmentSize));
+            if (size_t(end - data) < segmentSize) return false;
+            size_t first = segment * SEGMENT_BYTES;
+            size_t last = std::min(count, first + SEGMENT_BYTES);
+            bool ok = interleaved ? ransDecodeSegment<2>(table, data, data + segmentSize, bytes + first, last - first)
+                                  : ransDecodeSegment<1>(table, data, data + segmentSize, bytes + first, last - first);
+            if (!ok) return false;
+            data += segmentSize;
+        }
+    }
+
+    residuals.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        residuals[i] = planes[i] | planes[count + i] << 8 | planes[2 * count + i] << 16 | uint32_t(planes[3 * count + i]) << 24;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef PARTICLE_CODEC_HPP
+#define PARTICLE_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "task_graph.hpp"
+
+// Compression of per-body data over consecutive frames, e.g. one field of a trajectory chunk.
+// Input is a run of frames, each the same number of 32-bit words (floats by their bit pattern),
+// body i at the same place in every frame.
+//
+// Lossless: every word is predicted from the same word of the two previous frames, as an integer
+// (linear extrapolation; the first frame of a run is not predicted, the second from the first), and
+// only the difference is kept. For smooth motion the high bytes of the differences are zero. Stronger
+// than XOR against the previous frame (Gorilla style), which leaves a whole word of noise when a value
+// crosses a power of two. The differences are split into four byte planes, each entropy-coded on its
+// own with rANS, since sign/exponent bytes repeat a lot and low mantissa bytes hardly at all. Planes
+// are cut into segments that encode in parallel, and within a segment two rANS states take turns so
+// one core keeps both busy.
+//
+// Lossy: each value is quantized to a multiple of twice the tolerance, counted from the origin of its
+// tile, i.e. the smallest value of that component among a run of bodies over all frames. Tiles keep the
+// counts small, and within 32 bits, wherever the bodies are. The counts are integers, so they are
+// predicted from earlier frames exactly like lossless words, and only the prediction error is coded;
+// smooth motion leaves one or two nonzero byte planes. Decoded values are within the tolerance of the
+// original, up to rounding the result to float.
+//
+// Encoded form, per plane:
+//   mode (zero / raw / rANS), segment count
+//   rANS only: frequency table, the size of every segment, the segments
+//   raw only: the plane as is
+
+class ParticleCodec {
+    public:
+    // Append the encoding of 'frameCount' frames of 'frameWords' words each to 'out', using 'pool'
+    void encodeLossless(const uint32_t* words, size_t frameCount, size_t frameWords, std::vector<unsigned char>& out,
+                        WorkerPool& pool);
+    // Inverse of encodeLossless into 'words', frameCount * frameWords of them. Returns false if
+    // 'data' is damaged or of another size
+    bool decodeLossless(const unsigned char* data, size_t size, size_t frameCount, size_t frameWords, uint32_t* words);
+    // Same for floats, each frame 'frameWords' values of 'components' interleaved components (3 for
+    // vec3), to within 'tolerance'. Appends nothing and returns false if a value is not finite or a
+    // tile spans more than 2^32 steps; the caller then stores the frames losslessly
+    bool encodeLossy(const float* values, size_t frameCount, size_t frameWords, unsigned int components, float tolerance,
+                     std::vector<unsigned char>& out, WorkerPool& pool);
+    bool decodeLossy(const unsigned char* data, size_t size, size_t frameCount, size_t frameWords, float* values);
+
+    private:
+    // Entropy stage shared by the codecs: byte planes of 'residuals', then rANS
+    void encodeWords(size_t count, std::vector<unsigned char>& out, WorkerPool& pool);
+    bool decodeWords(const unsigned char* data, size_t size, size_t count);
+
+    // Scratch, kept between calls so steady-state encoding does not allocate
+    std::vector<uint32_t> quantized; // Lossy only
+    std::vector<float> origins; // Lossy only, per tile and component
+    std::vector<uint32_t> residuals;
+    std::vector<unsigned char> planes; // Four planes of residuals.size() bytes, least significant first
+    std::vector<uint32_t> histograms; // Byte counts of every segment
+    std::vector<std::vector<unsigned char>> segments; // Encoded segments of every plane
+};
+
+#endif
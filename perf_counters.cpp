@@ -0,0 +1,174 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Single precision FLOPs one core can retire per cycle: 8-wide AVX2 with two FMA ports, counting
+// an FMA as two. This is the roof the achieved rate is compared against; adjust for other cores
+static const double PEAK_FLOPS_PER_CYCLE = 32.0;
+
+static const char* const PHASE_NAMES[PERF_PHASE_COUNT] = {"broadphase", "force", "integrate", "render submit"};
+
+// Counter slots. The cycle counter leads the group, so all of them are scheduled together
+enum PerfCounter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES, // Last level cache
+    COUNTER_BRANCH_MISSES,
+    COUNTER_TIME, // Scope wall time in nanoseconds, measured with steady_clock
+    COUNTER_COUNT
+};
+
+struct PhaseTotals {
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    std::atomic<uint64_t> items;
+    std::atomic<uint64_t> passes;
+    std::atomic<double> flops;
+};
+
+static bool enabled = false;
+static PhaseTotals totals[PERF_PHASE_COUNT];
+
+#ifdef __linux__
+static const uint32_t HARDWARE_EVENTS[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                           PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+static const unsigned int HARDWARE_EVENT_COUNT = 4;
+
+static int openCounter(uint32_t config, int groupFd) {
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFd == -1; // The leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // This thread only, on whatever CPU it runs
+    return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+// Counter group of the calling thread. Descriptors belong to the process, not the thread, so they are
+// closed when the thread exits; pools are rebuilt on every restart and would leak them otherwise
+struct CounterGroup {
+    int fds[HARDWARE_EVENT_COUNT] = {-1, -1, -1, -1}; // Leader first
+    bool failed = false;
+
+    ~CounterGroup() { closeAll(); }
+    void closeAll() {
+        for (int &fd : fds) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+    }
+};
+static thread_local CounterGroup group;
+
+static bool threadGroup() {
+    if (group.fds[0] >= 0) return true;
+    if (group.failed) return false;
+
+    for (unsigned int i = 0; i < HARDWARE_EVENT_COUNT; i++) {
+        group.fds[i] = openCounter(HARDWARE_EVENTS[i], i == 0 ? -1 : group.fds[0]);
+        if (group.fds[i] < 0) {
+            group.closeAll();
+            group.failed = true;
+            return false;
+        }
+    }
+    ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+static bool readGroup(uint64_t* values) {
+    // PERF_FORMAT_GROUP layout: event count, then one value per event
+    uint64_t buffer[1 + HARDWARE_EVENT_COUNT];
+    if (read(group.fds[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer)) return false;
+    for (unsigned int i = 0; i < HARDWARE_EVENT_COUNT; i++) values[i] = buffer[1 + i];
+    return true;
+}
+#else
+static bool threadGroup() { return false; }
+static bool readGroup(uint64_t*) { return false; }
+#endif
+
+static uint64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool perfCountersInit() {
+    enabled = false;
+    if (!std::getenv("GRAVITY_PERF_COUNTERS")) return false;
+    enabled = true;
+    // Probe on this thread, so a kernel that refuses shows up now instead of as an empty report
+    if (!threadGroup()) {
+        std::cerr << "perf_event_open failed; check /proc/sys/kernel/perf_event_paranoid. Counters disabled\n";
+        enabled = false;
+    }
+    return enabled;
+}
+
+bool perfCountersEnabled() {
+    return enabled;
+}
+
+PerfScope::PerfScope(PerfPhase phase, uint64_t workItems, double flopsPerItem)
+    : phase(phase), workItems(workItems), flopsPerItem(flopsPerItem) {
+    active = enabled && threadGroup() && readGroup(startValues);
+    if (active) startValues[COUNTER_TIME] = nowNanoseconds();
+}
+
+PerfScope::~PerfScope() {
+    if (!active) return;
+    uint64_t endValues[COUNTER_COUNT];
+    endValues[COUNTER_TIME] = nowNanoseconds();
+    if (!readGroup(endValues)) return;
+
+    PhaseTotals &phaseTotals = totals[phase];
+    for (unsigned int i = 0; i < COUNTER_COUNT; i++) {
+        phaseTotals.counters[i].fetch_add(endValues[i] - startValues[i], std::memory_order_relaxed);
+    }
+    phaseTotals.items.fetch_add(workItems, std::memory_order_relaxed);
+    phaseTotals.passes.fetch_add(1, std::memory_order_relaxed);
+    phaseTotals.flops.fetch_add(workItems * flopsPerItem, std::memory_order_relaxed);
+}
+
+void printPerfReport(std::ostream& out) {
+    if (!enabled) return;
+    out << "Performance counters per phase:\n";
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    for (unsigned int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        const PhaseTotals &phaseTotals = totals[phase];
+        uint64_t passes = phaseTotals.passes.load();
+        if (passes == 0) continue;
+
+        double cycles = phaseTotals.counters[COUNTER_CYCLES].load();
+        double instructions = phaseTotals.counters[COUNTER_INSTRUCTIONS].load();
+        double seconds = phaseTotals.counters[COUNTER_TIME].load() / 1e9;
+        double items = phaseTotals.items.load();
+        double flops = phaseTotals.flops.load();
+
+        out << "  " << PHASE_NAMES[phase] << " (" << passes << " passes, " << seconds * 1e3 << " ms): "
+            << "IPC " << (cycles > 0 ? instructions / cycles : 0.0)
+            << ", cache misses/1k instr " << (instructions > 0 ? phaseTotals.counters[COUNTER_CACHE_MISSES].load() * 1e3 / instructions : 0.0)
+            << ", branch misses/1k instr " << (instructions > 0 ? phaseTotals.counters[COUNTER_BRANCH_MISSES].load() * 1e3 / instructions : 0.0);
+        if (items > 0 && cycles > 0) out << ", items/cycle " << items / cycles;
+        if (flops > 0 && seconds > 0 && cycles > 0) {
+            // Time is summed over threads, so this is the rate per core against the per-core roof
+            out << ", " << flops / seconds / 1e9 << " GFLOP/s per core (" << 100.0 * flops / (cycles * PEAK_FLOPS_PER_CYCLE)
+                << "% of " << PEAK_FLOPS_PER_CYCLE << " FLOP/cycle peak)";
+        }
+        out << "\n";
+    }
+    out.flags(flags);
+}
@@ -0,0 +1,46 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <ostream>
+
+// Hardware performance counters per phase, via Linux perf_event_open.
+// Off by default; perfCountersInit() turns them on when GRAVITY_PERF_COUNTERS is set and the
+// kernel allows it (perf_event_paranoid <= 2, or CAP_PERFMON). Every thread that enters a
+// PerfScope opens its own counter group on first use; scopes read the group at entry and exit and
+// add the difference to the phase, so phases split over worker threads are summed correctly.
+
+enum PerfPhase {
+    PERF_BROADPHASE,
+    PERF_FORCE,
+    PERF_INTEGRATE,
+    PERF_RENDER_SUBMIT,
+    PERF_PHASE_COUNT
+};
+
+// Returns whether counting is enabled
+bool perfCountersInit();
+bool perfCountersEnabled();
+
+// Counts one pass over a phase on the calling thread. 'workItems' are the units the phase processes
+// (pair interactions for the force loop, bodies for integration), 'flopsPerItem' an estimate of the
+// floating point operations per item, used for GFLOP/s
+class PerfScope {
+    public:
+    PerfScope(PerfPhase phase, uint64_t workItems, double flopsPerItem = 0.0);
+    ~PerfScope();
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+    private:
+    PerfPhase phase;
+    uint64_t workItems;
+    double flopsPerItem;
+    bool active;
+    uint64_t startValues[5];
+};
+
+// Per phase: cycles, IPC, cache and branch misses, items per cycle, GFLOP/s against the compute roof
+void printPerfReport(std::ostream& out);
+
+#endif
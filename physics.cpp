@@ -0,0 +1,92 @@
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <math.h>
+
+#include "physics.hpp"
+
+void findOverlappingPairs(const std::vector<Sphere>& spheres, std::vector<uint32_t>& order, std::vector<SpherePair>& pairs) {
+    pairs.clear();
+    // The previous step's order is kept and only repaired; it starts over when the body count changes
+    if (order.size() != spheres.size()) {
+        order.resize(spheres.size());
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    }
+    // Sorted by the left edge of each sphere's x interval. Insertion sort: the order barely changes
+    // between steps, so this is close to linear
+    for (size_t i = 1; i < order.size(); i++) {
+        uint32_t current = order[i];
+        float minX = spheres[current].pos.x - spheres[current].radius;
+        size_t j = i;
+        for (; j > 0 && spheres[order[j - 1]].pos.x - spheres[order[j - 1]].radius > minX; j--) order[j] = order[j - 1];
+        order[j] = current;
+    }
+
+    // Only spheres whose x intervals overlap get the exact test
+    for (size_t i = 0; i < order.size(); i++) {
+        const Sphere &first = spheres[order[i]];
+        float maxX = first.pos.x + first.radius;
+        for (size_t j = i + 1; j < order.size(); j++) {
+            const Sphere &second = spheres[order[j]];
+            if (second.pos.x - second.radius > maxX) break;
+
+            float radii = first.radius + second.radius;
+            glm::vec3 dr = second.pos - first.pos;
+            if (glm::dot(dr, dr) < radii * radii) {
+                pairs.push_back({std::min(order[i], order[j]), std::max(order[i], order[j])});
+            }
+        }
+    }
+}
+
+void resolveOverlaps(std::vector<Sphere>& spheres, const std::vector<SpherePair>& pairs) {
+    for (const SpherePair &pair : pairs) {
+        Sphere &circle = spheres[pair.a];
+        Sphere &circle2 = spheres[pair.b];
+
+        // An earlier correction may already have separated them
+        glm::vec3 dr = circle2.pos - circle.pos;
+        float dist = glm::length(dr);
+        if (dist >= circle.radius + circle2.radius || dist == 0.f) continue;
+
+        float overlap = circle.radius + circle2.radius - dist;
+        glm::vec3 correction = dr/dist * (overlap * 0.5f);
+
+        circle.pos = circle.pos - correction;
+        circle2.pos = circle2.pos + correction;
+    }
+}
+
+void computeForces(std::vector<Sphere>& spheres, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        Sphere &circle = spheres[i];
+        circle.acc = glm::vec3(0.f);
+
+        for (size_t j = 0; j < spheres.size(); j++) {
+            if (j == i) continue;
+            const Sphere &circle2 = spheres[j];
+
+            glm::vec3 dr = circle2.pos - circle.pos;
+            float dist = glm::length(dr);
+            // Touching spheres are handled by resolveOverlaps
+            if (dist < circle.radius + circle2.radius) continue;
+
+            glm::vec3 direction = dr / dist;
+            glm::vec3 Gforce = direction * (G * circle.mass * circle2.mass) / (powf(10,9)*dist*dist);
+            circle.applyForce(Gforce);
+        }
+    }
+}
+
+void integrateSpheres(std::vector<Sphere>& spheres, size_t begin, size_t end, float dt) {
+    for (size_t i = begin; i < end; i++) spheres[i].updatePos(dt);
+}
+
+void stepSpheres(std::vector<Sphere>& spheres, float dt) {
+    std::vector<uint32_t> order;
+    std::vector<SpherePair> pairs;
+    findOverlappingPairs(spheres, order, pairs);
+    resolveOverlaps(spheres, pairs);
+    computeForces(spheres, 0, spheres.size());
+    integrateSpheres(spheres, 0, spheres.size(), dt);
+}
@@ -0,0 +1,78 @@
+#ifndef PHYSICS_HPP
+#define PHYSICS_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const float G = 6.6743E-11;
+
+class Sphere {
+    public:
+    glm::vec3 pos;
+    glm::vec3 vel;
+    glm::vec3 acc;
+
+    float radius;
+    float mass;
+
+    glm::vec3 color;
+
+    Sphere(glm::vec3 pos, glm::vec3 vel, float radius, long double mass, glm::vec3 color = glm::vec3(0.1686f, 0.7529f, 0.051f))
+        : pos(pos), vel(vel), radius(radius), mass(mass), color(color) {
+        acc = glm::vec3(0.f, 0.f, 0.f);
+    }
+
+    void applyForce(glm::vec3 force) {
+        acc += force / mass;
+    }
+
+    void updatePos(float dt) {
+        //glm::mat4 transformation = glm::mat4(1.f); // Identity
+        //transformation = glm::translate(transformation, vel);
+        //pos = trans * pos;
+        
+        //glm::vec4 transformedPos = transformation * glm::vec4(pos, 1.0f);
+        //pos = glm::vec3(transformedPos);
+        vel = vel + acc * dt;
+        pos = pos + vel * dt;
+
+        // Collision detection (Window range: -1 to 1)
+        if (pos.x + radius > 1.0f || pos.x - radius < -1.0f){
+            vel.x = -vel.x * 0.75;
+        }
+        if (pos.z + radius > 1.0f || pos.z - radius < -1.0f){
+            vel.z = -vel.z * 0.75;
+        }
+        if (pos.y + radius > 1.0f || pos.y - radius < -1.0f) {
+            vel.y = -vel.y * 0.75;
+            pos.y = glm::clamp(pos.y, -1.0f + radius, 1.0f - radius); // Prevent overshooting
+        }
+    }
+};
+
+// Two spheres that intersect
+struct SpherePair {
+    uint32_t a;
+    uint32_t b;
+};
+
+// One physics step split into phases, so a scheduler can run them as separate tasks.
+// In order: findOverlappingPairs -> resolveOverlaps -> computeForces -> integrateSpheres
+
+// Broadphase: sort-and-sweep along x. Only reads the spheres. 'order' carries the sort order from one
+// step to the next, so pass the same vector every step; clear it when the bodies change
+void findOverlappingPairs(const std::vector<Sphere>& spheres, std::vector<uint32_t>& order, std::vector<SpherePair>& pairs);
+// Push overlapping spheres apart. Sequential, since a sphere can be part of several pairs
+void resolveOverlaps(std::vector<Sphere>& spheres, const std::vector<SpherePair>& pairs);
+// Gravity on spheres [begin, end). Reads all positions and writes only acc, so ranges can run in parallel
+void computeForces(std::vector<Sphere>& spheres, size_t begin, size_t end);
+// Advance spheres [begin, end) by 'dt' seconds
+void integrateSpheres(std::vector<Sphere>& spheres, size_t begin, size_t end, float dt);
+
+// Advance all spheres by 'dt' seconds: every phase above, single-threaded
+void stepSpheres(std::vector<Sphere>& spheres, float dt);
+
+#endif
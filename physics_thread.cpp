@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "physics_thread.hpp"
+#include "perf_counters.hpp"
+#include "profiler.hpp"
+
+// Most real time the simulation may fall behind. When stepping is slower than real time, the simulation
+// slows down instead of falling further and further behind
+static const double MAX_FRAME_TIME = 0.25;
+
+// Steps between diagnostics printouts
+static const uint64_t DIAGNOSTICS_INTERVAL = 600;
+
+// Smallest range handed to a worker; the force grain is part of the SolverConfig
+static const size_t INTEGRATE_GRAIN = 256;
+
+// Chunk sizes of deterministic mode, independent of the worker count
+static const size_t DETERMINISTIC_FORCE_CHUNK = 64;
+static const size_t DETERMINISTIC_INTEGRATE_CHUNK = INTEGRATE_GRAIN;
+
+// Overlapping pairs reserved per body. A close-packed body touches 12 others and each pair is shared by
+// two bodies, so collapsed scenarios settle near 6; more only in transient pile-ups
+static const size_t PAIRS_PER_BODY = 8;
+
+// Bodies per partial sum of the diagnostics. Fixed, so the sums come out the same on any thread count
+static const size_t DIAGNOSTICS_BLOCK = 1024;
+
+// Floating point operations per body in updatePos, for GFLOP/s reports
+static const double FLOPS_PER_BODY = 12.0;
+
+double physicsClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float PhysicsSnapshot::interpolation(double now) const {
+    // The displayed state trails the newest step by one step: prevPos is shown when the step is due
+    // and pos once a full step of real time has passed after that
+    float alpha = float((now - dueTime) / PHYSICS_DT);
+    // Never extrapolate past the newest state; a late step shows as a brief pause, not an overshoot
+    return alpha < 0.f ? 0.f : (alpha > 1.f ? 1.f : alpha);
+}
+
+unsigned int defaultPhysicsWorkers() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 2 ? cores - 2 : 0;
+}
+
+void PhysicsThread::start(std::vector<Sphere> spheres, unsigned int workerCount) {
+    SimulationState state;
+    state.spheres = std::move(spheres);
+    start(std::move(state), workerCount);
+}
+
+void PhysicsThread::start(SimulationState state, unsigned int workerCount) {
+    stop();
+    prepare(std::move(state), workerCount, true);
+    thread = std::thread([this] {
+        PROFILE_THREAD("physics");
+        graph->run(*pool);
+    });
+}
+
+void PhysicsThread::run(std::vector<Sphere> spheres, uint64_t steps, unsigned int workerCount) {
+    SimulationState state;
+    state.spheres = std::move(spheres);
+    run(std::move(state), steps, workerCount);
+}
+
+void PhysicsThread::run(SimulationState state, uint64_t steps, unsigned int workerCount) {
+    stop();
+    prepare(std::move(state), workerCount, false);
+    graph->run(*pool, steps);
+    saveTune();
+}
+
+void PhysicsThread::setCheckpoints(const char* path, uint64_t interval) {
+    checkpointPath = path ? path : "";
+    checkpointTempPath = checkpointPath + ".tmp";
+    checkpointInterval = interval;
+}
+
+void PhysicsThread::setTrajectory(TrajectoryWriter* writer, uint64_t interval) {
+    trajectory = writer;
+    trajectoryInterval = interval;
+}
+
+SimulationClock PhysicsThread::lastClock() const {
+    SimulationClock clock = startClock;
+    clock.step = lastStep;
+    clock.simTime = simTimeAt(lastStep);
+    return clock;
+}
+
+bool PhysicsThread::saveCheckpoint(const char* path) const {
+    return writeCheckpoint(path, spheres, sweepOrder, lastClock());
+}
+
+bool PhysicsThread::checkpointImage(std::vector<unsigned char>& image) const {
+    return buildCheckpointImage(spheres, sweepOrder, lastClock(), image);
+}
+
+void PhysicsThread::setAutotune(const char* scenario, uint64_t interval) {
+    if (scenario) autotuner.reset(new Autotuner(scenario));
+    else autotuner.reset();
+    autotuneInterval = interval;
+}
+
+void PhysicsThread::saveTune() {
+    if (!autotuner || !tuneUnsaved) return;
+    autotuner->save(unsavedTune);
+    tuneUnsaved = false;
+}
+
+void PhysicsThread::prepare(SimulationState state, unsigned int workerCount, bool realTime) {
+    this->spheres = std::move(state.spheres);
+    this->realTime = realTime;
+    if (state.clock.dt != 0.f && state.clock.dt != PHYSICS_DT) {
+        std::cerr << "Checkpoint was written with dt " << state.clock.dt << ", continuing with " << PHYSICS_DT << "\n";
+    }
+    startClock = state.clock;
+    startClock.dt = PHYSICS_DT;
+    lastStep = startClock.step;
+    for (auto &positions : prevPositions) positions.resize(this->spheres.size());
+    for (size_t i = 0; i < this->spheres.size(); i++) prevPositions[0][i] = this->spheres[i].pos;
+    // Sized up front so steady-state steps do not allocate; pairs only grow past this in pile-ups.
+    // A restart continues from the checkpoint's sweep order, otherwise the first step starts over
+    // from the new bodies' order
+    sweepOrder = std::move(state.sweepOrder);
+    if (sweepOrder.size() != this->spheres.size()) sweepOrder.clear();
+    sweepOrder.reserve(this->spheres.size());
+    pairs.reserve(this->spheres.size() * PAIRS_PER_BODY);
+    if (checkpointInterval && !checkpointPath.empty()) checkpointImageBuffer.reserve(checkpointSize(this->spheres.size()));
+    diagnosticsBlocks.resize((this->spheres.size() + DIAGNOSTICS_BLOCK - 1) / DIAGNOSTICS_BLOCK);
+    clockOrigin = physicsClock();
+    publish(startClock.step, prevPositions[0], clockOrigin);
+    if (trajectory && trajectoryInterval) trajectory->append(this->spheres, startClock.step, startClock.simTime);
+
+    pool.reset(new WorkerPool(workerCount));
+    // A choice from an earlier launch is trusted until the first periodic re-tune
+    if (autotuner && !deterministic) {
+        if (!autotuner->load(this->spheres.size(), solverConfig)) solverConfig = autotuner->tune(this->spheres, *pool);
+        autotuner->reserve(this->spheres, tree);
+    }
+    tuneFinished[0] = tuneFinished[1] = false;
+    buildGraph();
+}
+
+void PhysicsThread::stop() {
+    if (graph) graph->stop();
+    if (thread.joinable()) thread.join();
+    saveTune();
+}
+
+void PhysicsThread::buildGraph() {
+    graph.reset(new TaskGraph());
+    unsigned int pace = graph->addTask("pace", paceTask, this, true);
+    unsigned int broadphase = graph->addTask("broadphase", broadphaseTask, this);
+    unsigned int resolve = graph->addTask("resolve", resolveTask, this);
+    unsigned int tree = graph->addTask("tree", treeTask, this);
+    unsigned int force = graph->addTask("force", forceTask, this);
+    unsigned int integrate = graph->addTask("integrate", integrateTask, this);
+    unsigned int diagnostics = graph->addTask("diagnostics", diagnosticsTask, this);
+    unsigned int publish = graph->addTask("publish", publishTask, this);
+    unsigned int io = graph->addTask("io", ioTask, this);
+    unsigned int checkpoint = graph->addTask("checkpoint", checkpointTask, this);
+    unsigned int trajectory = graph->addTask("trajectory", trajectoryTask, this);
+
+    graph->addDependency(broadphase, pace);
+    graph->addDependency(resolve, broadphase);
+    graph->addDependency(tree, resolve);
+    graph->addDependency(force, tree);
+    graph->addDependency(integrate, force);
+    graph->addDependency(diagnostics, integrate);
+    graph->addDependency(publish, integrate);
+    graph->addDependency(io, diagnostics);
+    graph->addDependency(checkpoint, integrate);
+    graph->addDependency(trajectory, integrate);
+
+    // Positions are read by the broadphase, diagnostics, publish and the outputs, and moved by resolve and
+    // integrate. Checkpoints also hold the sweep order, which the broadphase changes
+    graph->addFrameDependency(broadphase, integrate);
+    graph->addFrameDependency(broadphase, checkpoint);
+    graph->addFrameDependency(resolve, diagnostics);
+    graph->addFrameDependency(resolve, publish);
+    graph->addFrameDependency(resolve, trajectory);
+
+    reportedAllocations.assign(graph->taskCount(), AllocationCounts());
+}
+
+void PhysicsThread::paceTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    double now = physicsClock();
+    if (!physics->realTime) {
+        physics->dueTimes[frame % 2] = now;
+        physics->stepStarts[frame % 2] = now;
+        return;
+    }
+
+    double due = physics->clockOrigin + (frame + 1) * double(PHYSICS_DT);
+    if (now - due > MAX_FRAME_TIME) {
+        physics->clockOrigin += now - due - MAX_FRAME_TIME;
+        due = now - MAX_FRAME_TIME;
+    }
+    physics->dueTimes[frame % 2] = due;
+
+    // Sleep until the step is due; behind schedule, steps run back to back until caught up
+    if (due > now) std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+    physics->stepStarts[frame % 2] = physicsClock();
+}
+
+void PhysicsThread::broadphaseTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    std::vector<glm::vec3> &positions = physics->prevPositions[frame % 2];
+    for (size_t i = 0; i < physics->spheres.size(); i++) positions[i] = physics->spheres[i].pos;
+    PerfScope counters(PERF_BROADPHASE, physics->spheres.size());
+    findOverlappingPairs(physics->spheres, physics->sweepOrder, physics->pairs);
+}
+
+void PhysicsThread::resolveTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    resolveOverlaps(physics->spheres, physics->pairs);
+    physics->diagnostics[frame % 2].overlaps = physics->pairs.size();
+}
+
+void PhysicsThread::treeTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    bool &finished = physics->tuneFinished[frame % 2];
+    finished = false;
+    if (physics->autotuner && !physics->deterministic) {
+        // Trials run on the tuner's copy of the bodies, one pass per step until all candidates are done
+        Autotuner &autotuner = *physics->autotuner;
+        if (frame > 0 && physics->autotuneInterval != 0 && frame % physics->autotuneInterval == 0) autotuner.begin(physics->spheres);
+        finished = autotuner.advance(*physics->pool, physics->tuneResults[frame % 2]);
+        if (finished) physics->solverConfig = physics->tuneResults[frame % 2].config;
+    }
+    if (physics->solverConfig.solver == ForceSolver::BarnesHut) physics->tree.build(physics->spheres, physics->solverConfig.leafSize);
+}
+
+void PhysicsThread::forceTask(void* self, uint64_t) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    computeForcesParallel(*physics->pool, physics->spheres, physics->spheres.size(), physics->solverConfig, physics->tree,
+                          physics->deterministic ? DETERMINISTIC_FORCE_CHUNK : 0);
+}
+
+static void integrateRange(void* context, size_t begin, size_t end) {
+    PerfScope counters(PERF_INTEGRATE, end - begin, FLOPS_PER_BODY);
+    integrateSpheres(*static_cast<std::vector<Sphere>*>(context), begin, end, PHYSICS_DT);
+}
+
+void PhysicsThread::integrateTask(void* self, uint64_t) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    if (physics->deterministic) {
+        physics->pool->parallelForChunks(physics->spheres.size(), DETERMINISTIC_INTEGRATE_CHUNK, integrateRange, &physics->spheres);
+    } else {
+        physics->pool->parallelFor(physics->spheres.size(), INTEGRATE_GRAIN, integrateRange, &physics->spheres);
+    }
+}
+
+struct DiagnosticsJob {
+    const std::vector<Sphere>* spheres;
+    std::vector<PhysicsDiagnostics>* blocks;
+};
+
+// Partial sums of the diagnostics over blocks [begin, end), DIAGNOSTICS_BLOCK bodies each
+static void diagnosticsRange(void* context, size_t begin, size_t end) {
+    const DiagnosticsJob &job = *static_cast<DiagnosticsJob*>(context);
+    for (size_t block = begin; block < end; block++) {
+        PhysicsDiagnostics &partial = (*job.blocks)[block];
+        partial.kineticEnergy = 0.0;
+        partial.momentum = glm::dvec3(0.0);
+        size_t last = std::min((block + 1) * DIAGNOSTICS_BLOCK, job.spheres->size());
+        for (size_t i = block * DIAGNOSTICS_BLOCK; i < last; i++) {
+            const Sphere &sphere = (*job.spheres)[i];
+            glm::dvec3 vel(sphere.vel);
+            partial.kineticEnergy += 0.5 * sphere.mass * glm::dot(vel, vel);
+            partial.momentum += double(sphere.mass) * vel;
+        }
+    }
+}
+
+void PhysicsThread::diagnosticsTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    std::vector<PhysicsDiagnostics> &blocks = physics->diagnosticsBlocks;
+    DiagnosticsJob job = {&physics->spheres, &blocks};
+    physics->pool->parallelForChunks(blocks.size(), 1, diagnosticsRange, &job);
+
+    // Pairwise in a fixed order: neighbours first, then pairs of pairs, and so on
+    for (size_t width = 1; width < blocks.size(); width *= 2) {
+        for (size_t i = 0; i + width < blocks.size(); i += 2 * width) {
+            blocks[i].kineticEnergy += blocks[i + width].kineticEnergy;
+            blocks[i].momentum += blocks[i + width].momentum;
+        }
+    }
+    PhysicsDiagnostics &diagnostics = physics->diagnostics[frame % 2];
+    diagnostics.kineticEnergy = blocks.empty() ? 0.0 : blocks[0].kineticEnergy;
+    diagnostics.momentum = blocks.empty() ? glm::dvec3(0.0) : blocks[0].momentum;
+}
+
+void PhysicsThread::publishTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    physics->publish(physics->stepOf(frame), physics->prevPositions[frame % 2], physics->dueTimes[frame % 2]);
+    physics->stepTimeHistogram.record(uint64_t((physicsClock() - physics->stepStarts[frame % 2]) * 1e9));
+}
+
+void PhysicsThread::ioTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    uint64_t step = physics->stepOf(frame);
+    if (physics->tuneFinished[frame % 2]) {
+        // Stored once stepping stops: that reads and rewrites a file
+        physics->unsavedTune = physics->tuneResults[frame % 2];
+        physics->tuneUnsaved = true;
+        if (physics->realTime) printAutotuneResult(std::cout, physics->unsavedTune);
+    }
+    if (!physics->realTime || step % DIAGNOSTICS_INTERVAL != 0) return;
+
+    const PhysicsDiagnostics &diagnostics = physics->diagnostics[frame % 2];
+    std::cout << "Step " << step << ": kinetic energy " << diagnostics.kineticEnergy
+              << ", momentum " << glm::length(diagnostics.momentum)
+              << ", overlaps " << diagnostics.overlaps << std::endl;
+
+    // Steps are expected not to allocate once the buffers have grown, i.e. after the first interval.
+    // Tasks of this step that are still running are counted in the next report
+    TaskGraph &graph = *physics->graph;
+    bool allocated = false;
+    for (unsigned int task = 0; task < graph.taskCount(); task++) {
+        AllocationCounts now = graph.taskAllocations(task);
+        AllocationCounts made = now - physics->reportedAllocations[task];
+        physics->reportedAllocations[task] = now;
+        if (step - physics->startClock.step <= DIAGNOSTICS_INTERVAL || made.allocations == 0) continue;
+        if (!allocated) std::cerr << "Physics steps " << step - DIAGNOSTICS_INTERVAL << "-" << step << " allocated:";
+        std::cerr << " " << graph.taskName(task) << " " << made.allocations << "/" << made.bytes << " bytes";
+        allocated = true;
+    }
+    if (allocated) std::cerr << std::endl;
+}
+
+void PhysicsThread::checkpointTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    // Positions and the sweep order are stable here: the next broadphase waits for this task
+    uint64_t step = physics->stepOf(frame);
+    physics->lastStep = step;
+    if (physics->checkpointInterval == 0 || physics->checkpointPath.empty() || step % physics->checkpointInterval != 0) return;
+    if (!physics->checkpointImage(physics->checkpointImageBuffer)) return;
+    writeCheckpointImage(physics->checkpointPath.c_str(), physics->checkpointTempPath.c_str(), physics->checkpointImageBuffer);
+}
+
+void PhysicsThread::trajectoryTask(void* self, uint64_t frame) {
+    PhysicsThread* physics = static_cast<PhysicsThread*>(self);
+    uint64_t step = physics->stepOf(frame);
+    if (!physics->trajectory || physics->trajectoryInterval == 0 || step % physics->trajectoryInterval != 0) return;
+    // Copies the bodies; the writer's thread does the I/O
+    physics->trajectory->append(physics->spheres, step, physics->simTimeAt(step));
+}
+
+void PhysicsThread::publish(uint64_t step, const std::vector<glm::vec3>& prevPositions, double dueTime) {
+    PhysicsSnapshot &snapshot = buffer.writeBuffer();
+    // The recycled buffer keeps its capacity, so this only allocates while the body count grows
+    snapshot.bodies.resize(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        snapshot.bodies[i] = {spheres[i].pos, spheres[i].radius, prevPositions[i], spheres[i].color};
+    }
+    snapshot.step = step;
+    snapshot.simTime = simTimeAt(step);
+    snapshot.dueTime = dueTime;
+    buffer.publish();
+}
@@ -0,0 +1,182 @@
+#ifndef PHYSICS_THREAD_HPP
+#define PHYSICS_THREAD_HPP
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "autotuner.hpp"
+#include "barnes_hut.hpp"
+#include "checkpoint.hpp"
+#include "force_solver.hpp"
+#include "latency_histogram.hpp"
+#include "physics.hpp"
+#include "task_graph.hpp"
+#include "trajectory.hpp"
+#include "triple_buffer.hpp"
+
+// Fixed physics timestep in seconds. Rendering interpolates between steps, so this can be
+// far below the display rate
+const float PHYSICS_DT = 1.f / 60.f;
+
+// What the renderer needs of one body
+struct BodyState {
+    glm::vec3 pos;
+    float radius;
+    glm::vec3 prevPos; // Position one step earlier, for interpolation
+    glm::vec3 color;
+};
+
+// Immutable copy of the simulation after one step
+struct PhysicsSnapshot {
+    std::vector<BodyState> bodies;
+    uint64_t step = 0;
+    double simTime = 0.0; // Seconds of simulated time
+    double dueTime = 0.0; // Wall clock (steady_clock seconds) at which this step was scheduled to start
+
+    // How far the displayed state should be from prevPos (0) towards pos (1) at wall time 'now'
+    float interpolation(double now) const;
+};
+
+// Seconds on the clock PhysicsSnapshot::dueTime is measured with
+double physicsClock();
+
+// Conservation checks computed after every step
+struct PhysicsDiagnostics {
+    double kineticEnergy = 0.0;
+    glm::dvec3 momentum = glm::dvec3(0.0);
+    size_t overlaps = 0; // Pairs pushed apart in this step
+};
+
+// Worker threads beside the physics and render threads
+unsigned int defaultPhysicsWorkers();
+
+// Steps the simulation at a fixed rate on its own thread and publishes a snapshot after every step.
+// The render thread picks up the latest one with snapshots().acquire() without ever blocking.
+//
+// A step is a TaskGraph executed on a WorkerPool, one frame per step:
+//   pace -> broadphase -> resolve -> tree -> force -> integrate -> publish
+//                                                              |-> diagnostics -> io
+//                                                              |-> checkpoint
+//                                                              \-> trajectory
+// Tree builds the Barnes-Hut octree when that solver is selected, and runs one slice of a periodic
+// re-tune when autotuning is on. Force and integrate are split over the workers. Consecutive steps overlap: the broadphase of
+// step k+1 runs while step k is still being published, checked and logged
+class PhysicsThread {
+    public:
+    PhysicsThread() = default;
+    PhysicsThread(const PhysicsThread&) = delete;
+    PhysicsThread& operator=(const PhysicsThread&) = delete;
+    ~PhysicsThread() { stop(); }
+
+    // Take ownership of the initial state and start stepping. The initial state is
+    // published before this returns, so the first frame always has something to draw
+    void start(std::vector<Sphere> spheres, unsigned int workerCount = defaultPhysicsWorkers());
+    // Continue a run from a checkpoint, at its step and simulated time
+    void start(SimulationState state, unsigned int workerCount = defaultPhysicsWorkers());
+    void stop();
+    // Headless: run 'steps' steps back to back on the calling thread, without pacing or console
+    // output, and return when they are done. For benchmarks; the result is in snapshots() as usual
+    void run(std::vector<Sphere> spheres, uint64_t steps, unsigned int workerCount = defaultPhysicsWorkers());
+    void run(SimulationState state, uint64_t steps, unsigned int workerCount = defaultPhysicsWorkers());
+
+    // Force solver for the next start() or run(); ignored while autotuning is on
+    void setSolver(const SolverConfig& config) { solverConfig = config; }
+    // Let an Autotuner pick the solver when starting and re-tune every 'interval' steps, remembering
+    // the choice under 'scenario'. Re-tunes are spread over the steps that follow, one trial pass per
+    // step, and their choice is stored once stepping stops. nullptr turns it off. Takes effect on the
+    // next start() or run()
+    void setAutotune(const char* scenario, uint64_t interval = AUTOTUNE_INTERVAL);
+    // Deterministic stepping: the same initial state and solver give bit-identical steps on every run
+    // and any worker count. Parallel phases are cut into fixed chunks instead of per-thread shares,
+    // and autotuning is skipped, since its choice depends on timing. Every body's sum already runs in
+    // index order on one thread, and reductions over bodies combine fixed blocks in a fixed order,
+    // so nothing else depends on the thread count. The cost is the load balancing of small counts
+    // and, mostly, the speed an autotuned solver would have found. Takes effect on the next start() or run()
+    void setDeterministic(bool enabled) { deterministic = enabled; }
+    // Write a checkpoint to 'path' after every step that is a multiple of 'interval'. Stepping waits
+    // while it is written. nullptr turns it off. Takes effect on the next start() or run()
+    void setCheckpoints(const char* path, uint64_t interval);
+    // Checkpoint of the last step. Only while stopped, e.g. on exit
+    bool saveCheckpoint(const char* path) const;
+    // The same in memory, as buildCheckpointImage() makes it, e.g. to compare whole states. Only while stopped
+    bool checkpointImage(std::vector<unsigned char>& image) const;
+    // Append the initial state and every step that is a multiple of 'interval' to 'writer', which must be
+    // open for this body count and outlive the run. nullptr turns it off. Takes effect on the next start() or run()
+    void setTrajectory(TrajectoryWriter* writer, uint64_t interval);
+
+    TripleBuffer<PhysicsSnapshot>& snapshots() { return buffer; }
+    // Wall time from a step starting (once due) to its snapshot being published. Safe to read while running
+    const LatencyHistogram& stepTimes() const { return stepTimeHistogram; }
+    // Graph of the current or last run, e.g. for its allocation counts per task; nullptr before the first.
+    // Safe to read while running once the first snapshot of the run is out
+    const TaskGraph* taskGraph() const { return graph.get(); }
+
+    private:
+    // Graph tasks; 'frame' k computes step k + 1
+    static void paceTask(void* self, uint64_t frame);
+    static void broadphaseTask(void* self, uint64_t frame);
+    static void resolveTask(void* self, uint64_t frame);
+    static void treeTask(void* self, uint64_t frame);
+    static void forceTask(void* self, uint64_t frame);
+    static void integrateTask(void* self, uint64_t frame);
+    static void diagnosticsTask(void* self, uint64_t frame);
+    static void publishTask(void* self, uint64_t frame);
+    static void ioTask(void* self, uint64_t frame);
+    static void checkpointTask(void* self, uint64_t frame);
+    static void trajectoryTask(void* self, uint64_t frame);
+
+    void prepare(SimulationState state, unsigned int workerCount, bool realTime);
+    void buildGraph();
+    void publish(uint64_t step, const std::vector<glm::vec3>& prevPositions, double dueTime);
+    // Store the last re-tune's choice, if not stored yet. Only while stopped
+    void saveTune();
+    // Step computed by graph frame 'frame', and the simulated time after a step
+    uint64_t stepOf(uint64_t frame) const { return startClock.step + frame + 1; }
+    double simTimeAt(uint64_t step) const { return startClock.simTime + (step - startClock.step) * double(PHYSICS_DT); }
+    SimulationClock lastClock() const;
+
+    std::vector<Sphere> spheres; // Physics thread and its workers only after start()
+    // Positions before each step, by step parity: publishing step k overlaps the broadphase of k + 1
+    std::vector<glm::vec3> prevPositions[2];
+    std::vector<uint32_t> sweepOrder;
+    std::vector<SpherePair> pairs;
+    SolverConfig solverConfig; // Written by the tree task only while running
+    BarnesHutTree tree;
+    std::unique_ptr<Autotuner> autotuner;
+    uint64_t autotuneInterval = AUTOTUNE_INTERVAL;
+    // By step parity: the tree task finished a re-tune in that step, with this result
+    bool tuneFinished[2] = {false, false};
+    AutotuneResult tuneResults[2];
+    AutotuneResult unsavedTune; // Written by the io task; stored by saveTune()
+    bool tuneUnsaved = false;
+    std::vector<AllocationCounts> reportedAllocations; // Per task, as of the last diagnostics printout
+    PhysicsDiagnostics diagnostics[2]; // By step parity, like prevPositions
+    std::vector<PhysicsDiagnostics> diagnosticsBlocks; // Partial sums per block of bodies
+    double dueTimes[2] = {0.0, 0.0};
+    double stepStarts[2] = {0.0, 0.0}; // By step parity: when pace let the step go
+    LatencyHistogram stepTimeHistogram;
+    double clockOrigin = 0.0; // Wall time of step 0; moves forward when stepping cannot keep up
+    bool realTime = true; // Paced to PHYSICS_DT and printing diagnostics; false inside run()
+    bool deterministic = false;
+    SimulationClock startClock; // Where the current run started
+    uint64_t lastStep = 0; // Last step completed, written by the checkpoint task
+    std::string checkpointPath; // Empty: no periodic checkpoints
+    std::string checkpointTempPath; // Written first, then renamed to checkpointPath
+    std::vector<unsigned char> checkpointImageBuffer; // Sized in prepare(), reused by every periodic checkpoint
+    uint64_t checkpointInterval = 0;
+    TrajectoryWriter* trajectory = nullptr;
+    uint64_t trajectoryInterval = 0;
+
+    std::unique_ptr<WorkerPool> pool;
+    std::unique_ptr<TaskGraph> graph;
+    TripleBuffer<PhysicsSnapshot> buffer;
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "profiler.hpp"
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t start; // Nanoseconds since the profiler's time origin
+    uint64_t end;
+};
+
+// One thread's recording. Owned by the registry, so events survive the thread exiting
+struct ProfileThread {
+    const char* name = nullptr;
+    unsigned int id = 0;
+    std::vector<ProfileEvent> events;
+    uint64_t written = 0; // Total events ever recorded; the ring holds the last PROFILER_EVENTS_PER_THREAD
+    ProfileEvent open[PROFILER_MAX_DEPTH];
+    unsigned int depth = 0;
+};
+
+static const std::chrono::steady_clock::time_point timeOrigin = std::chrono::steady_clock::now();
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ProfileThread>> registry;
+static thread_local ProfileThread* currentThread = nullptr;
+
+uint64_t profilerNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timeOrigin).count();
+}
+
+static ProfileThread* createRecord() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.emplace_back(new ProfileThread());
+    ProfileThread* record = registry.back().get();
+    record->id = registry.size();
+    record->events.resize(PROFILER_EVENTS_PER_THREAD);
+    return record;
+}
+
+// Registered on first use, so the ring is only allocated for threads that record anything
+static ProfileThread& threadRecord() {
+    if (!currentThread) currentThread = createRecord();
+    return *currentThread;
+}
+
+static void appendEvent(ProfileThread& record, const ProfileEvent& event) {
+    record.events[record.written % PROFILER_EVENTS_PER_THREAD] = event;
+    record.written++;
+}
+
+void profilerBegin(const char* name) {
+    ProfileThread &thread = threadRecord();
+    // Past the maximum depth zones are dropped, but still counted so begin/end stay paired
+    if (thread.depth < PROFILER_MAX_DEPTH) thread.open[thread.depth] = {name, profilerNow(), 0};
+    thread.depth++;
+}
+
+void profilerEnd() {
+    ProfileThread &thread = threadRecord();
+    if (thread.depth == 0) return;
+    thread.depth--;
+    if (thread.depth >= PROFILER_MAX_DEPTH) return;
+
+    ProfileEvent event = thread.open[thread.depth];
+    event.end = profilerNow();
+    appendEvent(thread, event);
+}
+
+void profilerThreadName(const char* name) {
+    threadRecord().name = name;
+}
+
+unsigned int profilerTrack(const char* name) {
+    ProfileThread* track = createRecord();
+    track->name = name;
+    return track->id;
+}
+
+void profilerRecord(unsigned int track, const char* name, uint64_t start, uint64_t end) {
+    ProfileThread* record;
+    {
+        // Tracks are few and recorded once per zone per frame; the lock only guards the registry growing
+        std::lock_guard<std::mutex> lock(registryMutex);
+        record = registry[track - 1].get();
+    }
+    appendEvent(*record, {name, start, end});
+}
+
+// Names are string literals from the source; escape them anyway so the JSON stays valid
+static void writeJsonString(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+bool profilerWriteTrace(const char* path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to write trace " << path << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    // Fixed notation: microsecond timestamps of a long run need more than the default 6 digits
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &thread : registry) {
+        if (thread->name) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+                 << ",\"args\":{\"name\":";
+            writeJsonString(file, thread->name);
+            file << "}}";
+            first = false;
+        }
+
+        uint64_t count = thread->written < PROFILER_EVENTS_PER_THREAD ? thread->written : PROFILER_EVENTS_PER_THREAD;
+        for (uint64_t i = thread->written - count; i < thread->written; i++) {
+            const ProfileEvent &event = thread->events[i % PROFILER_EVENTS_PER_THREAD];
+            // Complete events; timestamps in microseconds
+            file << (first ? "" : ",\n") << "{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id << ",\"ts\":" << event.start / 1000.0
+                 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
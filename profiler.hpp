@@ -0,0 +1,55 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+
+// Timing zones recorded into per-thread ring buffers and exported as Chrome trace-event JSON,
+// which chrome://tracing and ui.perfetto.dev open directly.
+//
+// Only compiled in with -DGRAVITY_PROFILER (make profile); otherwise every macro below is empty.
+//   PROFILE_ZONE("name")      times the rest of the enclosing scope
+//   PROFILE_BEGIN("name") ... PROFILE_END()  times a stretch of code without adding a scope
+//   PROFILE_THREAD("name")    labels the calling thread's track
+// Names must be string literals (or otherwise outlive the profiler); only the pointer is stored.
+
+// Events kept per thread. Older ones are overwritten once the ring is full
+const unsigned int PROFILER_EVENTS_PER_THREAD = 1 << 16;
+// Deepest nesting of open zones per thread
+const unsigned int PROFILER_MAX_DEPTH = 32;
+
+void profilerBegin(const char* name);
+void profilerEnd();
+void profilerThreadName(const char* name);
+
+// Timestamps for events that were not timed on the CPU, in the profiler's clock (nanoseconds)
+uint64_t profilerNow();
+// Extra timeline next to the thread tracks, e.g. for GPU work. Returns a handle for profilerRecord
+unsigned int profilerTrack(const char* name);
+// Add a finished event to a track. Each track must only be written by one thread
+void profilerRecord(unsigned int track, const char* name, uint64_t start, uint64_t end);
+// Write every recorded event to 'path'. Threads should be stopped or idle, since their rings are read
+// without locking. Returns false if the file could not be written
+bool profilerWriteTrace(const char* path);
+
+struct ProfileZone {
+    explicit ProfileZone(const char* name) { profilerBegin(name); }
+    ~ProfileZone() { profilerEnd(); }
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#ifdef GRAVITY_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_BEGIN(name) profilerBegin(name)
+#define PROFILE_END() profilerEnd()
+#define PROFILE_THREAD(name) profilerThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_BEGIN(name) ((void)0)
+#define PROFILE_END() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+#include <sched.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "option_parsing.hpp"
+#include "physics_thread.hpp"
+#include "scenarios.hpp"
+
+// Scaling study: runs the headless physics step over a matrix of scenarios, body counts and thread
+// counts and writes one CSV row per run. Built by 'make scaling'.
+//
+//   strong: fixed body count, more threads. Ideal is steps/s growing with the thread count
+//   weak:   work per thread fixed. Pair work is quadratic, so bodies grow with sqrt(threads)
+//
+// Every thread count runs twice where the machine has SMT: 'smt=0' puts each thread on its own
+// physical core, 'smt=1' fills both hardware threads of a core before moving to the next.
+//
+// Options, all optional:
+//   --scenarios uniform,cluster,disk,collision,clumps
+//   --sizes 1000,4000,16000     body counts for strong scaling
+//   --weak-size 2000            bodies at one thread for weak scaling
+//   --threads 1,2,4             thread counts; default powers of two up to every CPU we may run on
+//   --steps 10                  steps per run
+//   --out scaling.csv
+
+static const char* const DEFAULT_OUTPUT = "scaling.csv";
+
+struct ScalingOptions {
+    std::vector<Scenario> scenarios;
+    std::vector<size_t> sizes = {1000, 4000, 16000};
+    size_t weakSize = 2000;
+    std::vector<unsigned int> threads; // Empty: derived from the CPU count
+    uint64_t steps = 10;
+    std::string output = DEFAULT_OUTPUT;
+};
+
+// Logical CPUs this process may run on, in the two orders threads get placed in
+struct CpuTopology {
+    std::vector<int> spread; // One per physical core
+    std::vector<int> packed; // Every logical CPU, SMT siblings next to each other
+};
+
+static bool parseOptions(int argc, char** argv, ScalingOptions& options) {
+    options.scenarios.assign(SCENARIOS, SCENARIOS + SCENARIO_COUNT);
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        std::vector<uint64_t> numbers;
+        if (std::strcmp(option, "--scenarios") == 0) {
+            if (!parseScenarioList(value, options.scenarios)) return false;
+        } else if (std::strcmp(option, "--sizes") == 0) {
+            if (!parseNumberList(value, options.sizes)) return false;
+        } else if (std::strcmp(option, "--threads") == 0) {
+            if (!parseNumberList(value, options.threads)) return false;
+        } else if (std::strcmp(option, "--weak-size") == 0 || std::strcmp(option, "--steps") == 0) {
+            if (!parseNumberList(value, numbers) || numbers.size() != 1) return false;
+            if (option[2] == 'w') options.weakSize = numbers[0];
+            else options.steps = numbers[0];
+        } else if (std::strcmp(option, "--out") == 0) {
+            options.output = value;
+        } else {
+            std::cerr << "Unknown option " << option << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static int readSysfsNumber(int cpu, const char* name) {
+    std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name);
+    int value = -1;
+    file >> value;
+    return value;
+}
+
+static CpuTopology readCpuTopology() {
+    CpuTopology topology;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return topology;
+
+    // (package, core) -> logical CPUs, in CPU order. Without sysfs every CPU counts as its own core
+    std::map<std::pair<int, int>, std::vector<int>> cores;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        int package = readSysfsNumber(cpu, "physical_package_id");
+        int core = readSysfsNumber(cpu, "core_id");
+        if (core < 0) core = cpu;
+        cores[{package, core}].push_back(cpu);
+    }
+    for (const auto &core : cores) {
+        topology.spread.push_back(core.second[0]);
+        topology.packed.insert(topology.packed.end(), core.second.begin(), core.second.end());
+    }
+    return topology;
+}
+
+// Restrict the calling thread to the first 'count' CPUs of 'cpus'. Threads it starts afterwards,
+// i.e. the physics workers, inherit the mask
+static bool pinToCpus(const std::vector<int>& cpus, unsigned int count) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int i = 0; i < count && i < cpus.size(); i++) CPU_SET(cpus[i], &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Peak resident set size, reset before every run so each row reports its own peak
+static void resetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+static long peakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+// Steps per second of one headless run on 'threads' threads (the calling thread plus workers)
+static double measureSteps(Scenario scenario, size_t bodies, unsigned int threads, uint64_t steps, long& peakRss) {
+    std::vector<Sphere> spheres = generateScenario(scenario, bodies);
+    resetPeakRss();
+    auto start = std::chrono::steady_clock::now();
+    {
+        PhysicsThread physics;
+        physics.run(std::move(spheres), steps, threads - 1);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    peakRss = peakRssKb();
+    return steps / elapsed.count();
+}
+
+static std::vector<unsigned int> defaultThreadCounts(unsigned int cpuCount) {
+    std::vector<unsigned int> counts;
+    for (unsigned int count = 1; count < cpuCount; count *= 2) counts.push_back(count);
+    counts.push_back(cpuCount);
+    return counts;
+}
+
+int main(int argc, char** argv) {
+    ScalingOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--scenarios a,b] [--sizes n,m] [--weak-size n] [--threads a,b]"
+                  << " [--steps n] [--out file.csv]\n";
+        return 1;
+    }
+
+    cpu_set_t original;
+    sched_getaffinity(0, sizeof(original), &original);
+    CpuTopology topology = readCpuTopology();
+    if (topology.packed.empty()) {
+        std::cerr << "Failed to read the CPU affinity mask\n";
+        return 1;
+    }
+    bool hasSmt = topology.packed.size() > topology.spread.size();
+    std::cout << topology.spread.size() << " cores, " << topology.packed.size() << " hardware threads";
+    std::cout << (hasSmt ? "\n" : "; no SMT, skipping the smt=1 runs\n");
+
+    std::ofstream csv(options.output);
+    if (!csv) {
+        std::cerr << "Failed to write " << options.output << "\n";
+        return 1;
+    }
+    csv << "scenario,mode,smt,threads,bodies,steps,steps_per_second,pairs_per_second,speedup,efficiency,peak_rss_kb\n";
+
+    for (Scenario scenario : options.scenarios) {
+        for (int smt = 0; smt <= (hasSmt ? 1 : 0); smt++) {
+            const std::vector<int> &cpus = smt ? topology.packed : topology.spread;
+            std::vector<unsigned int> threadCounts = options.threads.empty() ? defaultThreadCounts(cpus.size()) : options.threads;
+
+            // Strong scaling runs one series per size; weak scaling is a single series
+            std::vector<size_t> series = options.sizes;
+            series.push_back(0);
+            for (size_t size : series) {
+                bool weak = size == 0;
+                double baseRate = 0.0; // Pairs per second on the first thread count of the series
+                unsigned int baseThreads = 0;
+                for (unsigned int threads : threadCounts) {
+                    if (threads > cpus.size()) {
+                        std::cerr << "Skipping " << threads << " threads: only " << cpus.size() << " CPUs available\n";
+                        continue;
+                    }
+                    size_t bodies = weak ? size_t(options.weakSize * std::sqrt(double(threads)) + 0.5) : size;
+                    if (!pinToCpus(cpus, threads)) std::cerr << "Failed to pin to " << threads << " CPUs\n";
+                    long peakRss = 0;
+                    double stepRate = measureSteps(scenario, bodies, threads, options.steps, peakRss);
+                    sched_setaffinity(0, sizeof(original), &original);
+
+                    double pairRate = stepRate * bodies * (bodies - 1);
+                    if (baseThreads == 0) {
+                        baseRate = pairRate;
+                        baseThreads = threads;
+                    }
+                    // Relative to the first run of the series, scaled as if that one had been linear
+                    double speedup = pairRate / baseRate * baseThreads;
+                    double efficiency = speedup / threads;
+
+                    csv << scenarioName(scenario) << "," << (weak ? "weak" : "strong") << "," << smt << "," << threads << ","
+                        << bodies << "," << options.steps << "," << stepRate << "," << pairRate << "," << speedup << ","
+                        << efficiency << "," << peakRss << std::endl;
+                    std::cout << scenarioName(scenario) << (weak ? " weak" : " strong") << " smt=" << smt << " threads="
+                              << threads << " bodies=" << bodies << ": " << stepRate << " steps/s, efficiency "
+                              << efficiency << std::endl;
+                }
+            }
+        }
+    }
+    return 0;
+}
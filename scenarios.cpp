@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "scenarios.hpp"
+
+// Radius of a body relative to the mean spacing of 'count' bodies in the box
+static const float RADIUS_FRACTION = 0.1f;
+// Plummer scale radius; the cluster is cut off at the box
+static const float CLUSTER_RADIUS = 0.2f;
+static const float DISK_RADIUS = 0.9f;
+static const float DISK_THICKNESS = 0.02f;
+// Collision: cluster centers and closing speed
+static const float COLLISION_OFFSET = 0.5f;
+static const float COLLISION_SPEED = 0.2f;
+// Clumps: how many, and their size relative to the single cluster
+static const unsigned int CLUMP_COUNT = 8;
+static const float CLUMP_SCALE = 0.25f;
+
+// xorshift32 and hand-rolled distributions: std:: distributions differ between standard libraries
+struct ScenarioRandom {
+    uint32_t state;
+
+    explicit ScenarioRandom(uint32_t seed) : state(seed ? seed : 1) {}
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // [0, 1)
+    float uniform() { return float(next() >> 8) * (1.f / 16777216.f); }
+    float uniform(float low, float high) { return low + (high - low) * uniform(); }
+
+    // Uniform on the unit sphere's surface
+    glm::vec3 direction() {
+        float z = uniform(-1.f, 1.f);
+        float angle = uniform(0.f, 6.28318530718f);
+        float r = std::sqrt(1.f - z * z);
+        return glm::vec3(r * std::cos(angle), r * std::sin(angle), z);
+    }
+};
+
+static glm::vec3 clampToBox(glm::vec3 pos, float radius) {
+    float limit = 1.f - radius;
+    return glm::clamp(pos, glm::vec3(-limit), glm::vec3(limit));
+}
+
+// Plummer density profile by inverting its cumulative mass, at rest
+static void addCluster(std::vector<Sphere>& spheres, ScenarioRandom& random, size_t count, glm::vec3 center,
+                       glm::vec3 velocity, float radius, float mass, float scale = CLUSTER_RADIUS) {
+    for (size_t i = 0; i < count; i++) {
+        float u = random.uniform(1e-3f, 1.f);
+        float distance = scale / std::sqrt(std::pow(u, -2.f / 3.f) - 1.f);
+        glm::vec3 pos = clampToBox(center + random.direction() * std::min(distance, 1.f), radius);
+        spheres.emplace_back(pos, velocity, radius, mass);
+    }
+}
+
+const char* scenarioName(Scenario scenario) {
+    switch (scenario) {
+        case Scenario::Uniform: return "uniform";
+        case Scenario::Cluster: return "cluster";
+        case Scenario::Disk: return "disk";
+        case Scenario::Collision: return "collision";
+        case Scenario::Clumps: return "clumps";
+    }
+    return "unknown";
+}
+
+bool parseScenario(const char* name, Scenario& scenario) {
+    for (Scenario candidate : SCENARIOS) {
+        if (std::strcmp(name, scenarioName(candidate)) == 0) {
+            scenario = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseScenarioList(const char* text, std::vector<Scenario>& scenarios) {
+    scenarios.clear();
+    std::string list(text);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string name = list.substr(start, comma - start);
+        Scenario scenario;
+        if (!parseScenario(name.c_str(), scenario)) {
+            std::cerr << "Unknown scenario " << name << "\n";
+            return false;
+        }
+        scenarios.push_back(scenario);
+        start = comma + 1;
+    }
+    return true;
+}
+
+std::vector<Sphere> generateScenario(Scenario scenario, size_t count, uint32_t seed) {
+    std::vector<Sphere> spheres;
+    if (count == 0) return spheres;
+    spheres.reserve(count);
+
+    ScenarioRandom random(seed);
+    float mass = float(SCENARIO_TOTAL_MASS / count);
+    float radius = RADIUS_FRACTION * 2.f / std::cbrt(float(count));
+
+    switch (scenario) {
+        case Scenario::Uniform:
+            for (size_t i = 0; i < count; i++) {
+                glm::vec3 pos(random.uniform(-1.f, 1.f), random.uniform(-1.f, 1.f), random.uniform(-1.f, 1.f));
+                spheres.emplace_back(clampToBox(pos, radius), glm::vec3(0.f), radius, mass);
+            }
+            break;
+        case Scenario::Cluster:
+            addCluster(spheres, random, count, glm::vec3(0.f), glm::vec3(0.f), radius, mass);
+            break;
+        case Scenario::Disk: {
+            // Uniform surface density: the mass inside r grows with r^2, and each body gets the
+            // circular speed for that mass. Same force scaling as computeForces
+            double gm = G * SCENARIO_TOTAL_MASS / 1e9;
+            for (size_t i = 0; i < count; i++) {
+                float r = DISK_RADIUS * std::sqrt(random.uniform(0.01f, 1.f));
+                float angle = random.uniform(0.f, 6.28318530718f);
+                glm::vec3 pos(r * std::cos(angle), random.uniform(-DISK_THICKNESS, DISK_THICKNESS), r * std::sin(angle));
+                float speed = float(std::sqrt(gm * (r / DISK_RADIUS) * (r / DISK_RADIUS) / r));
+                glm::vec3 vel = speed * glm::vec3(-std::sin(angle), 0.f, std::cos(angle));
+                spheres.emplace_back(clampToBox(pos, radius), vel, radius, mass);
+            }
+            break;
+        }
+        case Scenario::Collision:
+            addCluster(spheres, random, count / 2, glm::vec3(-COLLISION_OFFSET, 0.f, 0.f),
+                       glm::vec3(COLLISION_SPEED, 0.f, 0.f), radius, mass);
+            addCluster(spheres, random, count - count / 2, glm::vec3(COLLISION_OFFSET, 0.f, 0.f),
+                       glm::vec3(-COLLISION_SPEED, 0.f, 0.f), radius, mass);
+            break;
+        case Scenario::Clumps:
+            for (unsigned int c = 0; c < CLUMP_COUNT; c++) {
+                glm::vec3 center(random.uniform(-0.7f, 0.7f), random.uniform(-0.7f, 0.7f), random.uniform(-0.7f, 0.7f));
+                size_t clumpBodies = count * (c + 1) / CLUMP_COUNT - count * c / CLUMP_COUNT;
+                addCluster(spheres, random, clumpBodies, center, glm::vec3(0.f), radius, mass, CLUSTER_RADIUS * CLUMP_SCALE);
+            }
+            break;
+    }
+
+    // Stable, so equal keys keep their generation order
+    std::stable_sort(spheres.begin(), spheres.end(), [](const Sphere& a, const Sphere& b) {
+        return a.pos.x - a.radius < b.pos.x - b.radius;
+    });
+    return spheres;
+}
@@ -0,0 +1,37 @@
+#ifndef SCENARIOS_HPP
+#define SCENARIOS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "physics.hpp"
+
+// Standard initial conditions for benchmarks and studies. The bodies depend only on the scenario,
+// body count and seed, never on the standard library's random distributions, so results from
+// different releases and machines describe the same system
+enum class Scenario {
+    Uniform,   // Bodies at rest, spread evenly through the box: cold collapse
+    Cluster,   // Plummer sphere: dense core, sparse halo, many overlaps
+    Disk,      // Thin disk in circular orbits around its own mass
+    Collision, // Two clusters on a collision course
+    Clumps     // Many small Plummer clumps scattered through the box: clustered on several scales
+};
+
+const Scenario SCENARIOS[] = {Scenario::Uniform, Scenario::Cluster, Scenario::Disk, Scenario::Collision, Scenario::Clumps};
+const unsigned int SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+const uint32_t SCENARIO_SEED = 1;
+// Mass of the whole system, whatever the body count, so the dynamics look alike at every size
+const double SCENARIO_TOTAL_MASS = 7.35E17 * 4;
+
+const char* scenarioName(Scenario scenario);
+// Accepts the names returned by scenarioName
+bool parseScenario(const char* name, Scenario& scenario);
+// Comma-separated names. Prints to stderr and returns false on an unknown one
+bool parseScenarioList(const char* text, std::vector<Scenario>& scenarios);
+
+// 'count' bodies inside the [-1, 1] box, sorted along x like the broadphase keeps them
+std::vector<Sphere> generateScenario(Scenario scenario, size_t count, uint32_t seed = SCENARIO_SEED);
+
+#endif
@@ -40,13 +40,12 @@ void checkShaderCompileErrors(unsigned int shader, const char* flag) {
     }
 }
 
-// Assemble shader
-int createShaderProgram(const char* vertexSrc, const char* fragmentSrc) {
-    std::string vShaderSrc = readShader(vertexSrc);
-    std::string fShaderSrc = readShader(fragmentSrc);
-
-    const char* vShaderCode = vShaderSrc.c_str();
-    const char* fShaderCode = fShaderSrc.c_str();
+// Compile both stages and request the link without waiting for either.
+// With GL_KHR_parallel_shader_compile the driver works on it in the background until
+// finishShaderProgram (or any status query) is called.
+unsigned int beginShaderProgram(const std::string& vertexSrc, const std::string& fragmentSrc) {
+    const char* vShaderCode = vertexSrc.c_str();
+    const char* fShaderCode = fragmentSrc.c_str();
 
     // Create vertex shader object
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -54,23 +53,53 @@ int createShaderProgram(const char* vertexSrc, const char* fragmentSrc) {
     glShaderSource(vertexShader, 1, &vShaderCode, NULL);
     // Compile shader
     glCompileShader(vertexShader);
-    checkShaderCompileErrors(vertexShader, "VERTEX");
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
     glCompileShader(fragmentShader);
-    checkShaderCompileErrors(fragmentShader, "FRAGMENT");
 
     // Link shaders into a program object
     unsigned int shaderProgram = glCreateProgram();
 
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
+    // Allow glGetProgramBinary on the result, for the program binary cache
+    glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(shaderProgram);
+    return shaderProgram;
+}
+
+// Report compile and link errors of a program started by beginShaderProgram, then release its shaders.
+// Returns the link status
+bool finishShaderProgram(unsigned int shaderProgram) {
+    unsigned int shaders[2];
+    int shaderCount = 0;
+    glGetAttachedShaders(shaderProgram, 2, &shaderCount, shaders);
+
+    for (int i = 0; i < shaderCount; i++) {
+        int type;
+        glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+        checkShaderCompileErrors(shaders[i], type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT");
+    }
     checkShaderCompileErrors(shaderProgram, "PROGRAM");
 
     // Cleanup (shaders are now linked, so they can be deleted)
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    for (int i = 0; i < shaderCount; i++) {
+        glDetachShader(shaderProgram, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    int success;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    return success;
+}
+
+// Assemble shader
+int createShaderProgram(const char* vertexSrc, const char* fragmentSrc) {
+    std::string vShaderSrc = readShader(vertexSrc);
+    std::string fShaderSrc = readShader(fragmentSrc);
+
+    unsigned int shaderProgram = beginShaderProgram(vShaderSrc, fShaderSrc);
+    finishShaderProgram(shaderProgram);
     return shaderProgram;
-}
\ No newline at end of file
+}
@@ -4,6 +4,8 @@
 #include <string>
 
 int createShaderProgram(const char* vertexSrc, const char* fragmentSrc);
+unsigned int beginShaderProgram(const std::string& vertexSrc, const std::string& fragmentSrc);
+bool finishShaderProgram(unsigned int shaderProgram);
 std::string readShader(const std::string& path);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include <glad/glad.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "shader_cache.hpp"
+
+// GL_KHR_parallel_shader_compile is not part of the generated loader
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (*PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static bool parallelCompile = false;
+
+// Binary cache file layout: header, then 'length' bytes of driver-specific program binary
+struct ProgramBinaryHeader {
+    char magic[4]; // "GGLB"
+    uint32_t version;
+    uint64_t key; // Repeated from the file name, guards against stale or renamed files
+    uint32_t format; // Driver binary format passed back to glProgramBinary
+    uint32_t length;
+};
+
+static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+static uint64_t fnv1a(uint64_t hash, const std::string& data) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    // Separator, so ("ab", "c") and ("a", "bc") hash differently
+    hash ^= 0xff;
+    return hash * 1099511628211ull;
+}
+
+static std::string cachePath(const char* cacheDir, uint64_t key) {
+    std::stringstream ss;
+    ss << cacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return ss.str();
+}
+
+static bool hasExtension(const char* name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
+std::string shaderDriverString() {
+    std::string driver;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        driver += value ? value : "";
+        driver += '\n';
+    }
+    return driver;
+}
+
+uint64_t shaderCacheKey(const std::string& vertexSrc, const std::string& fragmentSrc, const std::string& driver) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, vertexSrc);
+    hash = fnv1a(hash, fragmentSrc);
+    return fnv1a(hash, driver);
+}
+
+unsigned int loadProgramBinary(const char* cacheDir, uint64_t key) {
+    int formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0) return 0;
+
+    std::ifstream file(cachePath(cacheDir, key), std::ios::binary | std::ios::ate);
+    if (!file) return 0;
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0);
+
+    ProgramBinaryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, "GGLB", 4) != 0 ||
+        header.version != PROGRAM_BINARY_VERSION || header.key != key) {
+        return 0;
+    }
+    // A damaged length must not size the buffer: the binary has to fit in what is left of the file
+    if (fileSize < std::streamoff(sizeof(header)) || header.length > uint64_t(fileSize) - sizeof(header)) return 0;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), binary.size());
+
+    // The driver may still refuse a binary, e.g. after an update that kept the version string
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool saveProgramBinary(const char* cacheDir, uint64_t key, unsigned int program) {
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+
+    ProgramBinaryHeader header;
+    memcpy(header.magic, "GGLB", 4);
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.length = length;
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.format = format;
+
+    mkdir(cacheDir, 0755);
+    // Write to a temporary name first so a concurrent launch never reads a partial file
+    std::string path = cachePath(cacheDir, key);
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), binary.size());
+    file.close();
+    if (!file || rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write shader cache entry " << path << std::endl;
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool initParallelShaderCompile(GLADloadproc load) {
+    const char* names[] = {"glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"};
+    const char* extensions[] = {"GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile"};
+
+    for (int i = 0; i < 2; i++) {
+        if (!hasExtension(extensions[i])) continue;
+        auto maxThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load(names[i]));
+        if (!maxThreads) continue;
+        // 0xFFFFFFFF: let the implementation pick the number of threads
+        maxThreads(0xFFFFFFFFu);
+        parallelCompile = true;
+        return true;
+    }
+    return false;
+}
+
+bool shaderProgramReady(unsigned int program) {
+    if (!parallelCompile) return true;
+    int complete = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
@@ -0,0 +1,31 @@
+#ifndef SHADER_CACHE_HPP
+#define SHADER_CACHE_HPP
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of the shader sources and the driver identification strings,
+// so editing a shader or updating the driver misses the cache and falls back to compiling.
+
+// Directory the binaries are stored in, relative to the working directory
+const char* const SHADER_CACHE_DIR = "shader_cache";
+
+// Vendor, renderer and version strings of the current context
+std::string shaderDriverString();
+uint64_t shaderCacheKey(const std::string& vertexSrc, const std::string& fragmentSrc, const std::string& driver);
+
+// Create a program from a cached binary. Returns 0 on a miss or if the driver rejects the binary
+unsigned int loadProgramBinary(const char* cacheDir, uint64_t key);
+// Store a successfully linked program
+bool saveProgramBinary(const char* cacheDir, uint64_t key, unsigned int program);
+
+// Let the driver compile and link on its own threads (GL_KHR_parallel_shader_compile).
+// 'load' resolves the extension entry point. Returns false if the extension is missing
+bool initParallelShaderCompile(GLADloadproc load);
+// Whether the program's link has finished, without blocking. Always true without the extension
+bool shaderProgramReady(unsigned int program);
+
+#endif
@@ -0,0 +1,120 @@
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "setup.hpp"
+#include "shader_program.hpp"
+
+bool ShaderProgram::create(const char* vertexPath, const char* fragmentPath, const char* cacheDir) {
+    ShaderProgram* programs[] = {this};
+    ShaderProgramSource sources[] = {{vertexPath, fragmentPath}};
+    return createAll(programs, sources, 1, cacheDir);
+}
+
+bool ShaderProgram::createAll(ShaderProgram* programs[], const ShaderProgramSource sources[], size_t count, const char* cacheDir) {
+    std::string driver = shaderDriverString();
+    std::vector<uint64_t> keys(count);
+    std::vector<size_t> pending; // Programs that missed the cache and are being compiled
+
+    for (size_t i = 0; i < count; i++) {
+        std::string vShaderSrc = readShader(sources[i].vertexPath);
+        std::string fShaderSrc = readShader(sources[i].fragmentPath);
+        keys[i] = shaderCacheKey(vShaderSrc, fShaderSrc, driver);
+
+        programs[i]->program = loadProgramBinary(cacheDir, keys[i]);
+        if (programs[i]->program == 0) {
+            programs[i]->program = beginShaderProgram(vShaderSrc, fShaderSrc);
+            pending.push_back(i);
+        }
+    }
+
+    // Status queries block until the link is done; wait until the driver reports completion
+    // for every program, so one slow link does not serialize the others
+    bool waiting = true;
+    while (waiting) {
+        waiting = false;
+        for (size_t i : pending) {
+            if (!shaderProgramReady(programs[i]->program)) waiting = true;
+        }
+        if (waiting) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    bool allLinked = true;
+    for (size_t i : pending) {
+        if (finishShaderProgram(programs[i]->program)) {
+            saveProgramBinary(cacheDir, keys[i], programs[i]->program);
+        } else {
+            glDeleteProgram(programs[i]->program);
+            programs[i]->program = 0;
+            allLinked = false;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (programs[i]->program) programs[i]->reflect();
+    }
+    return allLinked;
+}
+
+void ShaderProgram::destroy() {
+    if (program) glDeleteProgram(program);
+    program = 0;
+    uniforms.clear();
+    uniformBlocks.clear();
+}
+
+void ShaderProgram::use() const {
+    glUseProgram(program);
+}
+
+int ShaderProgram::uniform(const std::string& name) const {
+    auto it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
+}
+
+int ShaderProgram::uniformBlock(const std::string& name) const {
+    auto it = uniformBlocks.find(name);
+    return it == uniformBlocks.end() ? -1 : it->second;
+}
+
+void ShaderProgram::bindUniformBlock(const std::string& name, unsigned int binding) const {
+    int index = uniformBlock(name);
+    if (index < 0) {
+        std::cerr << "Uniform block '" << name << "' is not active in program " << program << std::endl;
+        return;
+    }
+    glUniformBlockBinding(program, index, binding);
+}
+
+void ShaderProgram::reflect() {
+    int count, maxLength;
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength > 0 ? maxLength : 1);
+    for (int i = 0; i < count; i++) {
+        int size;
+        GLenum type;
+        glGetActiveUniform(program, i, name.size(), nullptr, &size, &type, name.data());
+        // Members of uniform blocks are active uniforms too, but have no location
+        int location = glGetUniformLocation(program, name.data());
+        if (location < 0) continue;
+
+        std::string uniformName = name.data();
+        uniforms[uniformName] = location;
+        // Arrays are reported as "name[0]"; also allow looking them up by the bare name
+        size_t bracket = uniformName.find('[');
+        if (bracket != std::string::npos) uniforms[uniformName.substr(0, bracket)] = location;
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(maxLength > 0 ? maxLength : 1);
+    for (int i = 0; i < count; i++) {
+        glGetActiveUniformBlockName(program, i, name.size(), nullptr, name.data());
+        uniformBlocks[name.data()] = i;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SHADER_PROGRAM_HPP
+#define SHADER_PROGRAM_HPP
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+#include "shader_cache.hpp"
+
+// Vertex + fragment shader file pair of one program
+struct ShaderProgramSource {
+    const char* vertexPath;
+    const char* fragmentPath;
+};
+
+// Linked shader program with its active uniforms and uniform blocks reflected once at link time,
+// so the render loop never has to call glGetUniformLocation
+class ShaderProgram {
+    public:
+    bool create(const char* vertexPath, const char* fragmentPath, const char* cacheDir = SHADER_CACHE_DIR);
+    // Create several programs at once. Cached binaries are loaded directly; the rest are all
+    // submitted before any is waited on, so the driver can compile them in parallel.
+    // Returns false if any program fails to link
+    static bool createAll(ShaderProgram* programs[], const ShaderProgramSource sources[], size_t count, const char* cacheDir = SHADER_CACHE_DIR);
+    // Must be called while the context is current
+    void destroy();
+
+    void use() const;
+    unsigned int id() const { return program; }
+
+    // Location of an active uniform, or -1 if the program does not use it
+    int uniform(const std::string& name) const;
+    // Index of an active uniform block, or -1 if the program does not use it
+    int uniformBlock(const std::string& name) const;
+    // Source the named block from a buffer bound to 'binding' with glBindBufferRange
+    void bindUniformBlock(const std::string& name, unsigned int binding) const;
+
+    private:
+    void reflect();
+
+    unsigned int program = 0;
+    std::unordered_map<std::string, int> uniforms;
+    std::unordered_map<std::string, int> uniformBlocks;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "sphere_mesh.hpp"
+
+// Projected radius in pixels below which each level is used; anything larger gets the finest level
+static const float LOD_MAX_SCREEN_RADIUS[SPHERE_LOD_COUNT - 1] = {6.f, 24.f, 96.f};
+
+// Built entirely at compile time. Level 1 is the original 9x18 sphere
+static constexpr auto LOD0_MESH = buildSphereMesh<4, 8>();
+static constexpr auto LOD1_MESH = buildSphereMesh<9, 18>();
+static constexpr auto LOD2_MESH = buildSphereMesh<16, 32>();
+static constexpr auto LOD3_MESH = buildSphereMesh<24, 48>();
+
+template <unsigned int Stacks, unsigned int Sectors>
+static void appendLod(SphereMeshCache &cache, unsigned int level, const SphereMesh<Stacks, Sectors> &mesh) {
+    SphereLod &lod = cache.lods[level];
+    lod.stackCount = Stacks;
+    lod.sectorCount = Sectors;
+
+    // Indices stay local to the level; baseVertex shifts them at draw time
+    lod.baseVertex = cache.vertices.size() / 3;
+    lod.firstIndex = cache.indices.size();
+    lod.indexCount = mesh.indices.size();
+    lod.firstLineIndex = cache.lineIndices.size();
+    lod.lineIndexCount = mesh.lineIndices.size();
+
+    cache.vertices.insert(cache.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    cache.indices.insert(cache.indices.end(), mesh.indices.begin(), mesh.indices.end());
+    cache.lineIndices.insert(cache.lineIndices.end(), mesh.lineIndices.begin(), mesh.lineIndices.end());
+}
+
+SphereMeshCache buildSphereMeshCache() {
+    SphereMeshCache cache;
+    appendLod(cache, 0, LOD0_MESH);
+    appendLod(cache, 1, LOD1_MESH);
+    appendLod(cache, 2, LOD2_MESH);
+    appendLod(cache, 3, LOD3_MESH);
+    return cache;
+}
+
+unsigned int selectSphereLod(float screenRadius) {
+    unsigned int level = 0;
+    while (level < SPHERE_LOD_COUNT - 1 && screenRadius >= LOD_MAX_SCREEN_RADIUS[level]) level++;
+    return level;
+}
@@ -0,0 +1,272 @@
+#ifndef SPHERE_MESH_HPP
+#define SPHERE_MESH_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Sphere mesh build pipeline:
+//   1. generate a UV sphere with the seam column and pole rings welded into shared vertices
+//   2. emit 16-bit indices
+//   3. reorder triangles for the post-transform vertex cache (Tipsify)
+// Every step is constexpr, so the fixed LOD tessellations are built by the compiler.
+
+// Number of pre-generated tessellation levels
+const unsigned int SPHERE_LOD_COUNT = 4;
+
+// Post-transform cache size assumed by the triangle reordering
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// Location of one tessellation level inside the shared vertex and index buffers
+struct SphereLod {
+    unsigned int stackCount;
+    unsigned int sectorCount;
+    int baseVertex; // First vertex of this level in the shared VBO
+    unsigned int firstIndex; // Triangle indices in the shared EBO
+    unsigned int indexCount;
+    unsigned int firstLineIndex; // Wireframe indices in the shared line EBO
+    unsigned int lineIndexCount;
+};
+
+// Unit spheres at every LOD level, packed back to back so one VBO/EBO pair serves all of them
+struct SphereMeshCache {
+    SphereLod lods[SPHERE_LOD_COUNT];
+    std::vector<float> vertices; // xyz per vertex
+    std::vector<uint16_t> indices; // GL_UNSIGNED_SHORT
+    std::vector<uint16_t> lineIndices;
+};
+
+// sin/cos usable in constant expressions. Computed in double, so float results match libm
+constexpr double meshSin(double x) {
+    const double PI = 3.14159265358979323846;
+    // Reduce to [-pi, pi], then Taylor series; the remainder is below 1e-15 there
+    double turns = x / (2 * PI);
+    long long whole = (long long)(turns < 0 ? turns - 0.5 : turns + 0.5);
+    x -= whole * 2 * PI;
+
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 14; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double meshCos(double x) {
+    return meshSin(x + 3.14159265358979323846 / 2);
+}
+
+constexpr unsigned int sphereVertexCount(unsigned int stackCount, unsigned int sectorCount) {
+    return (stackCount - 1) * sectorCount + 2;
+}
+
+constexpr unsigned int sphereIndexCount(unsigned int stackCount, unsigned int sectorCount) {
+    return 3 * sectorCount * (2 * stackCount - 2);
+}
+
+constexpr unsigned int sphereLineIndexCount(unsigned int stackCount, unsigned int sectorCount) {
+    return 2 * sectorCount * (2 * stackCount - 1);
+}
+
+// Welded vertex for UV grid point (stack i, sector j). Both poles collapse into one vertex each
+// and sector 'sectorCount' wraps around to sector 0, so the seam is shared
+constexpr uint16_t weldedSphereIndex(unsigned int i, unsigned int j, unsigned int stackCount, unsigned int sectorCount) {
+    if (i == 0) return 0;
+    if (i == stackCount) return sphereVertexCount(stackCount, sectorCount) - 1;
+    return 1 + (i - 1) * sectorCount + j % sectorCount;
+}
+
+// Generate vertex data
+constexpr std::vector<float> generateSphereVertices(unsigned int stackCount, unsigned int sectorCount) {
+    const double PI = 3.14159265358979323846;
+    std::vector<float> vertices;
+    vertices.reserve(3 * sphereVertexCount(stackCount, sectorCount));
+
+    double sectorStep = 2 * PI / sectorCount;
+    double stackStep = PI / stackCount;
+
+    // North pole
+    vertices.push_back(0.f);
+    vertices.push_back(0.f);
+    vertices.push_back(1.f);
+
+    for (unsigned int i = 1; i < stackCount; i++) {
+        double stackAngle = i * stackStep;
+        double xy = meshSin(stackAngle);
+        double z = meshCos(stackAngle);
+
+        // One vertex per sector; the closing seam vertex is the first one again
+        for (unsigned int j = 0; j < sectorCount; j++) {
+            double sectorAngle = PI / 2 - j * sectorStep;
+
+            vertices.push_back(float(xy * meshCos(sectorAngle)));
+            vertices.push_back(float(xy * meshSin(sectorAngle)));
+            vertices.push_back(float(z));
+        }
+    }
+
+    // South pole
+    vertices.push_back(0.f);
+    vertices.push_back(0.f);
+    vertices.push_back(-1.f);
+    return vertices;
+}
+
+constexpr void generateSphereIndices(unsigned int stackCount, unsigned int sectorCount, std::vector<uint16_t>& indices, std::vector<uint16_t>& lineIndices) {
+    indices.reserve(indices.size() + sphereIndexCount(stackCount, sectorCount));
+    lineIndices.reserve(lineIndices.size() + sphereLineIndexCount(stackCount, sectorCount));
+
+    for (unsigned int i = 0; i < stackCount; ++i) {
+        for (unsigned int j = 0; j < sectorCount; ++j) {
+            uint16_t k1 = weldedSphereIndex(i, j, stackCount, sectorCount); // current stack
+            uint16_t k1Next = weldedSphereIndex(i, j + 1, stackCount, sectorCount);
+            uint16_t k2 = weldedSphereIndex(i + 1, j, stackCount, sectorCount); // next stack
+            uint16_t k2Next = weldedSphereIndex(i + 1, j + 1, stackCount, sectorCount);
+
+            // 2 triangles per sector excluding first and last stacks.
+            // At the poles the second vertex of the pair is the same pole, so only one triangle remains
+            if (i != 0) {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1Next);
+            }
+            if (i != stackCount - 1) {
+                indices.push_back(k1Next);
+                indices.push_back(k2);
+                indices.push_back(k2Next);
+            }
+
+            // vertical lines for all stacks, horizontal lines for all rings
+            lineIndices.push_back(k1);
+            lineIndices.push_back(k2);
+            if (i != 0) {
+                lineIndices.push_back(k1);
+                lineIndices.push_back(k1Next);
+            }
+        }
+    }
+}
+
+// Reorder triangles for a FIFO/LRU post-transform cache of 'cacheSize' entries.
+// Tipsify (Sander, Nehab, Barczak 2007): fan out from a vertex, emitting all of its remaining
+// triangles, then continue with the adjacent vertex that is still likely to be in the cache.
+constexpr std::vector<uint16_t> optimizeVertexCache(const std::vector<uint16_t>& indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+    unsigned int triangleCount = indices.size() / 3;
+
+    // Vertex -> triangle adjacency in CSR form; 'live' counts the not yet emitted triangles
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (uint16_t v : indices) live[v]++;
+    std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++) adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+    std::vector<unsigned int> adjacency(indices.size(), 0);
+    std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; t++) {
+        for (unsigned int k = 0; k < 3; k++) adjacency[fill[indices[3 * t + k]]++] = t;
+    }
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnd; // Recently used vertices, for restarting when a fan runs dry
+    std::vector<unsigned int> candidates;
+    std::vector<uint16_t> out;
+    deadEnd.reserve(indices.size());
+    out.reserve(indices.size());
+
+    unsigned int time = cacheSize + 1;
+    unsigned int cursor = 1; // Next vertex for the linear scan fallback
+    int fanning = vertexCount > 0 ? 0 : -1;
+
+    while (fanning >= 0) {
+        candidates.clear();
+        for (unsigned int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            for (unsigned int k = 0; k < 3; k++) {
+                uint16_t v = indices[3 * t + k];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Best candidate: still has work left and will still be cached after emitting it
+        int next = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) priority = time - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // Dead end: walk back through recent vertices, then scan linearly
+        while (next == -1 && !deadEnd.empty()) {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) next = v;
+        }
+        while (next == -1 && cursor < vertexCount) {
+            if (live[cursor] > 0) next = cursor;
+            cursor++;
+        }
+        fanning = next;
+    }
+    return out;
+}
+
+// Average cache miss ratio: vertex shader invocations per triangle with a FIFO cache.
+// 3.0 is the worst case, around 0.6-0.7 is typical for well ordered regular meshes
+constexpr float averageCacheMissRatio(const std::vector<uint16_t>& indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+    std::vector<unsigned int> insertedAt(vertexCount, 0); // 0 = never cached
+    unsigned int misses = 0;
+    for (uint16_t v : indices) {
+        if (insertedAt[v] == 0 || misses + 1 - insertedAt[v] > cacheSize) {
+            misses++;
+            insertedAt[v] = misses;
+        }
+    }
+    return indices.empty() ? 0.f : float(misses) / float(indices.size() / 3);
+}
+
+// A fully built sphere in fixed-size arrays, so it can live in a constexpr variable
+template <unsigned int Stacks, unsigned int Sectors>
+struct SphereMesh {
+    static constexpr unsigned int VERTEX_COUNT = sphereVertexCount(Stacks, Sectors);
+    static constexpr unsigned int INDEX_COUNT = sphereIndexCount(Stacks, Sectors);
+    static constexpr unsigned int LINE_INDEX_COUNT = sphereLineIndexCount(Stacks, Sectors);
+    static_assert(Stacks >= 2 && Sectors >= 3, "Degenerate sphere tessellation");
+    static_assert(VERTEX_COUNT <= 65536, "Sphere does not fit 16-bit indices");
+
+    std::array<float, 3 * VERTEX_COUNT> vertices;
+    std::array<uint16_t, INDEX_COUNT> indices;
+    std::array<uint16_t, LINE_INDEX_COUNT> lineIndices;
+};
+
+template <unsigned int Stacks, unsigned int Sectors>
+constexpr SphereMesh<Stacks, Sectors> buildSphereMesh() {
+    SphereMesh<Stacks, Sectors> mesh{};
+
+    std::vector<float> vertices = generateSphereVertices(Stacks, Sectors);
+    std::vector<uint16_t> indices;
+    std::vector<uint16_t> lineIndices;
+    generateSphereIndices(Stacks, Sectors, indices, lineIndices);
+    indices = optimizeVertexCache(indices, mesh.VERTEX_COUNT);
+
+    for (unsigned int i = 0; i < vertices.size(); i++) mesh.vertices[i] = vertices[i];
+    for (unsigned int i = 0; i < indices.size(); i++) mesh.indices[i] = indices[i];
+    for (unsigned int i = 0; i < lineIndices.size(); i++) mesh.lineIndices[i] = lineIndices[i];
+    return mesh;
+}
+
+SphereMeshCache buildSphereMeshCache();
+// Pick a level from the sphere's projected radius in pixels
+unsigned int selectSphereLod(float screenRadius);
+
+#endif
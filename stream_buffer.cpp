@@ -0,0 +1,97 @@
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "stream_buffer.hpp"
+
+bool StreamBuffer::create(GLenum target, size_t regionSize) {
+    // Regions start on a boundary that suits both uniform buffer bindings and mapped pointers, so the
+    // same class backs uniform and vertex data. Asked once; reserve() recreates with the same value
+    if (alignment == 0) {
+        GLint uniformAlignment = 0;
+        GLint mapAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        glGetIntegerv(GL_MIN_MAP_BUFFER_ALIGNMENT, &mapAlignment);
+        alignment = std::max<size_t>({1, size_t(std::max(uniformAlignment, 0)), size_t(std::max(mapAlignment, 0))});
+    }
+    this->target = target;
+    this->regionSize = (regionSize + alignment - 1) / alignment * alignment;
+    if (this->regionSize == 0) this->regionSize = alignment;
+    index = 0;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    size_t totalSize = this->regionSize * REGION_COUNT;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    // Immutable storage is required for a persistent mapping
+    glBufferStorage(target, totalSize, nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(target, 0, totalSize, flags));
+    glBindBuffer(target, 0);
+
+    if (mapped == nullptr) {
+        std::cerr << "Failed to persistently map stream buffer (" << totalSize << " bytes)" << std::endl;
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        return false;
+    }
+    return true;
+}
+
+void StreamBuffer::destroy() {
+    for (unsigned int i = 0; i < REGION_COUNT; i++) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+    if (buffer) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+}
+
+bool StreamBuffer::reserve(size_t regionSize) {
+    if (regionSize <= this->regionSize && buffer) return true;
+
+    // The GPU may still read any region; drain all of them before freeing the storage
+    for (unsigned int i = 0; i < REGION_COUNT; i++) waitFence(i);
+    destroy();
+    // Grow geometrically so a slowly increasing body count does not reallocate every frame
+    size_t newSize = this->regionSize * 2 > regionSize ? this->regionSize * 2 : regionSize;
+    return create(target, newSize);
+}
+
+void* StreamBuffer::map() {
+    waitFence(index);
+    return mapped + offset();
+}
+
+void StreamBuffer::unmap() {
+    fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    index = (index + 1) % REGION_COUNT;
+}
+
+void StreamBuffer::waitFence(unsigned int region) {
+    GLsync fence = fences[region];
+    if (!fence) return;
+
+    // Flush on the first wait so the fence is guaranteed to signal eventually
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fence, waitFlags, 1000000); // 1 ms
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) break;
+        if (result == GL_WAIT_FAILED) {
+            std::cerr << "glClientWaitSync failed on stream buffer region " << region << std::endl;
+            break;
+        }
+        waitFlags = 0;
+    }
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+}
@@ -0,0 +1,49 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Persistently mapped ring buffer for data that changes every frame.
+// The buffer is split into regions. The CPU writes into one region while the GPU
+// may still be reading the others; a fence per region tells when it is free again.
+class StreamBuffer {
+    public:
+    static const unsigned int REGION_COUNT = 3;
+
+    StreamBuffer() = default;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // Allocate storage for REGION_COUNT regions of at least 'regionSize' bytes each
+    bool create(GLenum target, size_t regionSize);
+    // Delete the buffer and fences. Must be called while the context is current
+    void destroy();
+
+    // Grow every region to at least 'regionSize' bytes. Waits for the GPU before reallocating
+    bool reserve(size_t regionSize);
+
+    // Wait until the current region is no longer read by the GPU and return a pointer to it
+    void* map();
+    // Fence the current region after the commands reading it are submitted, then move on
+    void unmap();
+
+    unsigned int id() const { return buffer; }
+    // Byte offset of the current region inside the buffer
+    size_t offset() const { return index * regionSize; }
+    size_t size() const { return regionSize; }
+
+    private:
+    void waitFence(unsigned int region);
+
+    GLenum target = GL_ARRAY_BUFFER;
+    unsigned int buffer = 0;
+    unsigned char* mapped = nullptr;
+    size_t regionSize = 0;
+    size_t alignment = 0; // Of region starts, from the GL limits
+    unsigned int index = 0;
+    GLsync fences[REGION_COUNT] = {};
+};
+
+#endif
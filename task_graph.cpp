@@ -0,0 +1,288 @@
+#include <chrono>
+
+#include "task_graph.hpp"
+#include "profiler.hpp"
+
+// Initial job queue size. It only grows if more jobs than this are ever queued at once
+static const size_t QUEUE_CAPACITY = 4096;
+
+// parallelFor bookkeeping. Lives on the caller's stack until every helper job has exited
+struct ParallelFor {
+    WorkerPool::RangeFunction function;
+    void* context;
+    size_t count;
+    size_t chunkSize;
+    size_t chunkCount;
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> finishedHelpers{0};
+};
+
+static void runChunks(ParallelFor* state) {
+    size_t chunk;
+    while ((chunk = state->nextChunk.fetch_add(1, std::memory_order_relaxed)) < state->chunkCount) {
+        size_t begin = chunk * state->chunkSize;
+        size_t end = begin + state->chunkSize < state->count ? begin + state->chunkSize : state->count;
+        state->function(state->context, begin, end);
+    }
+}
+
+static void parallelForHelper(void* context, uint64_t) {
+    ParallelFor* state = static_cast<ParallelFor*>(context);
+    PROFILE_ZONE("parallelFor");
+    runChunks(state);
+    state->finishedHelpers.fetch_add(1, std::memory_order_release);
+}
+
+void WorkerPool::JobQueue::push(const Job& job) {
+    if (count == jobs.size()) {
+        // Full: unroll the ring into a larger one
+        std::vector<Job> grown(jobs.size() * 2);
+        for (size_t i = 0; i < count; i++) grown[i] = jobs[(head + i) % jobs.size()];
+        jobs.swap(grown);
+        head = 0;
+    }
+    jobs[(head + count) % jobs.size()] = job;
+    count++;
+}
+
+bool WorkerPool::JobQueue::pop(Job& job) {
+    if (count == 0) return false;
+    job = jobs[head];
+    head = (head + 1) % jobs.size();
+    count--;
+    return true;
+}
+
+WorkerPool::WorkerPool(unsigned int threadCount) {
+    queue.jobs.resize(QUEUE_CAPACITY);
+    mainQueue.jobs.resize(QUEUE_CAPACITY);
+    for (unsigned int i = 0; i < threadCount; i++) threads.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) thread.join();
+}
+
+void WorkerPool::workerLoop() {
+    PROFILE_THREAD("worker");
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || queue.count > 0; });
+            if (!queue.pop(job)) return; // Stopping and drained
+        }
+        job.function(job.context, job.argument);
+    }
+}
+
+void WorkerPool::submit(const Job& job, bool mainThread) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mainThread) mainQueue.push(job);
+        else queue.push(job);
+    }
+    // Main-thread jobs have a single consumer that may be any of the waiters
+    if (mainThread) wake.notify_all();
+    else wake.notify_one();
+}
+
+bool WorkerPool::runOne(bool mainThread, bool wait) {
+    Job job;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto available = [&] { return (mainThread && mainQueue.count > 0) || queue.count > 0; };
+        // Bounded wait, so callers re-check their own exit condition regularly
+        if (wait && !available()) wake.wait_for(lock, std::chrono::milliseconds(1), available);
+        if (!(mainThread && mainQueue.pop(job)) && !queue.pop(job)) return false;
+    }
+    job.function(job.context, job.argument);
+    return true;
+}
+
+void WorkerPool::notifyAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_all();
+}
+
+void WorkerPool::parallelFor(size_t count, size_t grain, RangeFunction function, void* context, unsigned int maxThreads) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+    if (maxThreads == 0 || maxThreads > concurrency()) maxThreads = concurrency();
+
+    // A few chunks per thread, so uneven chunks still balance out
+    size_t chunkSize = count / (maxThreads * 4);
+    if (chunkSize < grain) chunkSize = grain;
+    runParallel(count, chunkSize, maxThreads, function, context);
+}
+
+void WorkerPool::parallelForChunks(size_t count, size_t chunkSize, RangeFunction function, void* context) {
+    if (count == 0) return;
+    runParallel(count, chunkSize ? chunkSize : 1, concurrency(), function, context);
+}
+
+void WorkerPool::runParallel(size_t count, size_t chunkSize, unsigned int maxThreads, RangeFunction function, void* context) {
+    ParallelFor state;
+    state.function = function;
+    state.context = context;
+    state.count = count;
+    state.chunkSize = chunkSize;
+    state.chunkCount = (count + chunkSize - 1) / chunkSize;
+
+    size_t helpers = state.chunkCount - 1 < maxThreads - 1 ? state.chunkCount - 1 : maxThreads - 1;
+    for (size_t i = 0; i < helpers; i++) submit({parallelForHelper, &state, 0});
+
+    runChunks(&state);
+
+    // Every helper must have exited before 'state' goes out of scope. Run other jobs meanwhile:
+    // a helper still in the queue may only get picked up by this thread
+    while (state.finishedHelpers.load(std::memory_order_acquire) < helpers) {
+        if (!runOne(false, false)) std::this_thread::yield();
+    }
+}
+
+unsigned int TaskGraph::addTask(const char* name, TaskFunction function, void* context, bool mainThreadOnly) {
+    Task task;
+    task.name = name;
+    task.function = function;
+    task.context = context;
+    task.mainThreadOnly = mainThreadOnly;
+    tasks.push_back(task);
+    return tasks.size() - 1;
+}
+
+void TaskGraph::addDependency(unsigned int task, unsigned int dependsOn) {
+    tasks[dependsOn].successors.push_back(task);
+    tasks[task].dependencyCount++;
+}
+
+void TaskGraph::addFrameDependency(unsigned int task, unsigned int dependsOn) {
+    // Every task already waits for itself in the previous frame
+    if (task == dependsOn) return;
+    tasks[dependsOn].frameSuccessors.push_back(task);
+    tasks[task].frameDependencyCount++;
+}
+
+void TaskGraph::run(WorkerPool& pool, uint64_t frameCount) {
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        this->pool = &pool;
+    }
+    this->frameCount = frameCount;
+    stopping = false;
+    openedFrames = 0;
+    completedFrames = 0;
+    for (auto &slot : pending) slot.reset(new std::atomic<int>[tasks.size()]);
+    allocations.reset(new std::atomic<uint64_t>[3 * tasks.size()]);
+    for (size_t i = 0; i < 3 * tasks.size(); i++) allocations[i] = 0;
+    for (auto &done : frameDone) done = false;
+    if (frameCount == 0 || tasks.empty()) return;
+
+    initFrame(0);
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        for (uint64_t frame = 0; frame < FRAMES_IN_FLIGHT && frame < frameCount; frame++) openFrame(frame);
+    }
+
+    // All work is done once every opened frame has completed
+    while (completedFrames.load(std::memory_order_acquire) < openedFrames.load(std::memory_order_acquire)) {
+        pool.runOne(true, true);
+    }
+    // The last completion may still be inside complete(); wait for it to leave the lock
+    std::lock_guard<std::mutex> lock(frameMutex);
+}
+
+void TaskGraph::stop() {
+    stopping = true;
+    std::lock_guard<std::mutex> lock(frameMutex);
+    if (pool) pool->notifyAll();
+}
+
+void TaskGraph::initFrame(uint64_t frame) {
+    unsigned int slot = frame % SLOT_COUNT;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        const Task &task = tasks[i];
+        // +1: held back until the frame is opened, which bounds the frames in flight
+        int count = task.dependencyCount + 1;
+        if (frame > 0) count += 1 + task.frameDependencyCount;
+        pending[slot][i].store(count, std::memory_order_relaxed);
+    }
+    remaining[slot].store(tasks.size(), std::memory_order_release);
+    frameDone[slot] = false;
+}
+
+void TaskGraph::openFrame(uint64_t frame) {
+    // Tasks of this frame report to the next one, so its counters must exist first.
+    // Its slot last held frame - 2, which is complete by the time this frame opens
+    if (frame + 1 < frameCount) initFrame(frame + 1);
+    openedFrames.store(frame + 1, std::memory_order_release);
+
+    for (unsigned int task = 0; task < tasks.size(); task++) release(task, frame);
+}
+
+void TaskGraph::schedule(unsigned int task, uint64_t frame) {
+    // Frame in the high bits, task in the low 16
+    pool->submit({executeJob, this, (frame << 16) | task}, tasks[task].mainThreadOnly);
+}
+
+void TaskGraph::release(unsigned int task, uint64_t frame) {
+    if (pending[frame % SLOT_COUNT][task].fetch_sub(1, std::memory_order_acq_rel) == 1) schedule(task, frame);
+}
+
+void TaskGraph::executeJob(void* graph, uint64_t argument) {
+    TaskGraph* self = static_cast<TaskGraph*>(graph);
+    unsigned int task = argument & 0xffff;
+    uint64_t frame = argument >> 16;
+
+    const Task &t = self->tasks[task];
+    AllocationCounts before = threadAllocationCounts();
+    PROFILE_BEGIN(t.name);
+    t.function(t.context, frame);
+    PROFILE_END();
+    AllocationCounts made = threadAllocationCounts() - before;
+    if (made.allocations || made.frees) {
+        self->allocations[3 * task].fetch_add(made.allocations, std::memory_order_relaxed);
+        self->allocations[3 * task + 1].fetch_add(made.frees, std::memory_order_relaxed);
+        self->allocations[3 * task + 2].fetch_add(made.bytes, std::memory_order_relaxed);
+    }
+    self->complete(task, frame);
+}
+
+AllocationCounts TaskGraph::taskAllocations(unsigned int task) const {
+    return {allocations[3 * task].load(std::memory_order_relaxed), allocations[3 * task + 1].load(std::memory_order_relaxed),
+            allocations[3 * task + 2].load(std::memory_order_relaxed)};
+}
+
+void TaskGraph::complete(unsigned int task, uint64_t frame) {
+    for (unsigned int successor : tasks[task].successors) release(successor, frame);
+    if (frame + 1 < frameCount) {
+        release(task, frame + 1);
+        for (unsigned int successor : tasks[task].frameSuccessors) release(successor, frame + 1);
+    }
+
+    // Count the task as finished last: after this, only the frame's final task may touch the
+    // graph, since run() can return as soon as the frame retires
+    if (remaining[frame % SLOT_COUNT].fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    // Frames can finish out of order by a hair; retire them in order under the lock, opening
+    // a new frame for each one retired
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameDone[frame % SLOT_COUNT] = true;
+        uint64_t completed = completedFrames.load(std::memory_order_relaxed);
+        while (completed < openedFrames.load(std::memory_order_relaxed) && frameDone[completed % SLOT_COUNT]) {
+            uint64_t next = completed + FRAMES_IN_FLIGHT;
+            // Open before publishing the completion, so run() never sees every frame finished in between
+            if (next < frameCount && !stopping.load(std::memory_order_acquire)) openFrame(next);
+            completed++;
+            completedFrames.store(completed, std::memory_order_release);
+        }
+        // Still under the lock: once run() can return, nothing here may touch the graph
+        pool->notifyAll();
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+
+// Unit of work queued on a WorkerPool. Plain function pointers instead of std::function,
+// so queuing never allocates
+struct Job {
+    void (*function)(void* context, uint64_t argument);
+    void* context;
+    uint64_t argument;
+};
+
+// Fixed set of worker threads sharing one job queue. The thread that owns the pool
+// (the one calling TaskGraph::run or parallelFor) executes jobs as well
+class WorkerPool {
+    public:
+    typedef void (*RangeFunction)(void* context, size_t begin, size_t end);
+
+    // 'threadCount' extra threads; 0 runs everything on the calling thread
+    explicit WorkerPool(unsigned int threadCount);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Threads that can execute work, including the calling thread
+    unsigned int concurrency() const { return threads.size() + 1; }
+
+    // Call function(context, begin, end) over [0, count) in chunks of at least 'grain' items,
+    // spread over at most 'maxThreads' threads of the pool (0: all of them). Returns when every
+    // chunk is done. Safe to call from inside a job
+    void parallelFor(size_t count, size_t grain, RangeFunction function, void* context, unsigned int maxThreads = 0);
+    // Same, but in chunks of exactly 'chunkSize' items (the last one may be shorter), however many
+    // threads the pool has. Which thread runs a chunk still varies, the chunk boundaries do not
+    void parallelForChunks(size_t count, size_t chunkSize, RangeFunction function, void* context);
+
+    // Queue a job. Main-thread jobs only run on the owning thread, inside runOne(true, ...)
+    void submit(const Job& job, bool mainThread = false);
+    // Run one queued job on the calling thread. With 'wait', block briefly for one to arrive.
+    // Returns false if nothing was run
+    bool runOne(bool mainThread, bool wait);
+    // Wake threads blocked in runOne, e.g. after an external condition changed
+    void notifyAll();
+
+    private:
+    // Ring of jobs; preallocated so queuing does not allocate in steady state
+    struct JobQueue {
+        std::vector<Job> jobs;
+        size_t head = 0;
+        size_t count = 0;
+
+        void push(const Job& job);
+        bool pop(Job& job);
+    };
+
+    void workerLoop();
+    void runParallel(size_t count, size_t chunkSize, unsigned int maxThreads, RangeFunction function, void* context);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    JobQueue queue;
+    JobQueue mainQueue;
+    bool stopping = false;
+};
+
+// Dependency graph of the phases of one frame, executed repeatedly on a WorkerPool.
+// Each task runs once per frame after its dependencies of the same frame. Frames overlap:
+// up to FRAMES_IN_FLIGHT frames execute at once, and a task of frame f+1 only waits for the
+// same task of frame f plus any declared frame dependencies, not for all of frame f.
+class TaskGraph {
+    public:
+    typedef void (*TaskFunction)(void* context, uint64_t frame);
+
+    static const unsigned int FRAMES_IN_FLIGHT = 2;
+
+    // Returns the task id used for declaring dependencies
+    unsigned int addTask(const char* name, TaskFunction function, void* context, bool mainThreadOnly = false);
+    // 'task' waits for 'dependsOn' of the same frame
+    void addDependency(unsigned int task, unsigned int dependsOn);
+    // 'task' waits for 'dependsOn' of the previous frame
+    void addFrameDependency(unsigned int task, unsigned int dependsOn);
+
+    // Execute frames 0 .. frameCount-1, or until stop(). The calling thread runs the
+    // main-thread tasks and helps with the others. The graph must not change while running
+    void run(WorkerPool& pool, uint64_t frameCount = UINT64_MAX);
+    // Start no further frames; run() returns once the frames in flight are done. Thread-safe
+    void stop();
+
+    const char* taskName(unsigned int task) const { return tasks[task].name; }
+    unsigned int taskCount() const { return tasks.size(); }
+    // Allocations made by a task since run() started. Includes jobs the task ran while waiting
+    // inside parallelFor. Safe to call from tasks
+    AllocationCounts taskAllocations(unsigned int task) const;
+
+    private:
+    // Frame counters live in FRAMES_IN_FLIGHT + 1 slots: the frames in flight plus the next one,
+    // which already receives completions from the frame before it
+    static const unsigned int SLOT_COUNT = FRAMES_IN_FLIGHT + 1;
+
+    struct Task {
+        const char* name;
+        TaskFunction function;
+        void* context;
+        bool mainThreadOnly;
+        unsigned int dependencyCount = 0;
+        unsigned int frameDependencyCount = 0;
+        std::vector<unsigned int> successors;
+        std::vector<unsigned int> frameSuccessors;
+    };
+
+    static void executeJob(void* graph, uint64_t argument);
+    void initFrame(uint64_t frame);
+    void openFrame(uint64_t frame);
+    void schedule(unsigned int task, uint64_t frame);
+    void release(unsigned int task, uint64_t frame);
+    void complete(unsigned int task, uint64_t frame);
+
+    std::vector<Task> tasks;
+
+    WorkerPool* pool = nullptr; // Written under frameMutex, stop() may read it from any thread
+    uint64_t frameCount = 0;
+    std::unique_ptr<std::atomic<int>[]> pending[SLOT_COUNT]; // Unmet dependencies per task
+    std::unique_ptr<std::atomic<uint64_t>[]> allocations; // Per task: allocations, frees, bytes
+    std::atomic<unsigned int> remaining[SLOT_COUNT]; // Tasks of the frame not yet finished
+    bool frameDone[SLOT_COUNT]; // Guarded by frameMutex
+    std::mutex frameMutex; // Serializes opening and retiring frames
+    std::atomic<uint64_t> openedFrames{0};
+    std::atomic<uint64_t> completedFrames{0};
+    std::atomic<bool> stopping{false};
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+
+#include "text_overlay.hpp"
+
+// 5x7 font for ASCII ' ' to 'Z'. One byte per column, left to right; bit 0 is the top row
+static const unsigned char FONT_FIRST = ' ';
+static const unsigned int FONT_GLYPHS = 'Z' - ' ' + 1;
+static const unsigned char FONT[FONT_GLYPHS][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, // ' ' ! "
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, // # $ %
+    {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00}, // & ' (
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x08, 0x2A, 0x1C, 0x2A, 0x08}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // ) * +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, // , - .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, // / 0 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10}, // 2 3 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03}, // 5 6 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, // 8 9 :
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14}, // ; < =
+    {0x41, 0x22, 0x14, 0x08, 0x00}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E}, // > ? @
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // A B C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x01, 0x01}, // D E F
+    {0x3E, 0x41, 0x41, 0x51, 0x32}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, // G H I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40}, // J K L
+    {0x7F, 0x02, 0x04, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // M N O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, // P Q R
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, // S T U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x7F, 0x20, 0x18, 0x20, 0x7F}, {0x63, 0x14, 0x08, 0x14, 0x63}, // V W X
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43},                                 // Y Z
+};
+
+// Atlas layout: 6x8 pixel cells (glyph plus one pixel of spacing), ATLAS_COLUMNS per row
+static const unsigned int CELL_WIDTH = 6;
+static const unsigned int CELL_HEIGHT = 8;
+static const unsigned int ATLAS_COLUMNS = 16;
+static const unsigned int ATLAS_ROWS = (FONT_GLYPHS + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+
+// Vertex attribute locations and buffer binding in overlay_vertex.glsl
+static const unsigned int POSITION_ATTRIBUTE = 0;
+static const unsigned int GLYPH_ATTRIBUTE = 1;
+static const unsigned int GLYPH_BINDING = 0;
+
+bool TextOverlay::create(const ShaderProgram& program) {
+    this->program = &program;
+    screenSizeLocation = program.uniform("screenSize");
+
+    // Rasterize the font into a one-channel atlas; row 0 of the image is the top of the first glyph row
+    const unsigned int width = ATLAS_COLUMNS * CELL_WIDTH;
+    const unsigned int height = ATLAS_ROWS * CELL_HEIGHT;
+    unsigned char pixels[width * height];
+    memset(pixels, 0, sizeof(pixels));
+    for (unsigned int glyph = 0; glyph < FONT_GLYPHS; glyph++) {
+        unsigned int cellX = glyph % ATLAS_COLUMNS * CELL_WIDTH;
+        unsigned int cellY = glyph / ATLAS_COLUMNS * CELL_HEIGHT;
+        for (unsigned int column = 0; column < 5; column++) {
+            for (unsigned int row = 0; row < 7; row++) {
+                if (FONT[glyph][column] & (1 << row)) pixels[(cellY + row) * width + cellX + column] = 255;
+            }
+        }
+    }
+
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, width, height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // Nearest filtering keeps the pixel font crisp at integer scales
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Quads come from gl_VertexID; only the per-glyph instance data is sourced from a buffer
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+    glVertexAttribFormat(POSITION_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, offsetof(GlyphInstance, x));
+    glVertexAttribBinding(POSITION_ATTRIBUTE, GLYPH_BINDING);
+    glEnableVertexAttribArray(GLYPH_ATTRIBUTE);
+    glVertexAttribIFormat(GLYPH_ATTRIBUTE, 1, GL_UNSIGNED_INT, offsetof(GlyphInstance, glyph));
+    glVertexAttribBinding(GLYPH_ATTRIBUTE, GLYPH_BINDING);
+    glVertexBindingDivisor(GLYPH_BINDING, 1);
+    glBindVertexArray(0);
+
+    return instances.create(GL_ARRAY_BUFFER, sizeof(glyphs));
+}
+
+void TextOverlay::destroy() {
+    glDeleteTextures(1, &atlas);
+    glDeleteVertexArrays(1, &vao);
+    instances.destroy();
+    atlas = 0;
+    vao = 0;
+}
+
+void TextOverlay::clear() {
+    glyphCount = 0;
+}
+
+float TextOverlay::lineHeight() const {
+    return (CELL_HEIGHT + 2) * GLYPH_SCALE;
+}
+
+void TextOverlay::print(float x, float y, const char* text) {
+    float lineX = x;
+    for (const char* c = text; *c && glyphCount < MAX_GLYPHS; c++) {
+        if (*c == '\n') {
+            x = lineX;
+            y += lineHeight();
+            continue;
+        }
+        char upper = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+        unsigned int glyph = upper >= FONT_FIRST && upper < FONT_FIRST + (int)FONT_GLYPHS ? upper - FONT_FIRST : '?' - FONT_FIRST;
+        if (upper != ' ') glyphs[glyphCount++] = {x, y, glyph, 0};
+        x += CELL_WIDTH * GLYPH_SCALE;
+    }
+}
+
+void TextOverlay::draw(int screenWidth, int screenHeight) {
+    if (glyphCount == 0) return;
+
+    void* mapped = instances.map();
+    memcpy(mapped, glyphs, glyphCount * sizeof(GlyphInstance));
+
+    // Text goes over everything and is never hidden by the spheres
+    glDisable(GL_DEPTH_TEST);
+    program->use();
+    glUniform2f(screenSizeLocation, (float)screenWidth, (float)screenHeight);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glBindVertexArray(vao);
+    glBindVertexBuffer(GLYPH_BINDING, instances.id(), instances.offset(), sizeof(GlyphInstance));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphCount);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+
+    instances.unmap();
+}
@@ -0,0 +1,53 @@
+#ifndef TEXT_OVERLAY_HPP
+#define TEXT_OVERLAY_HPP
+
+#include <cstdint>
+
+#include "shader_program.hpp"
+#include "stream_buffer.hpp"
+
+// On-screen text in a built-in 5x7 pixel font. Glyphs are queued with print() and drawn together
+// in one instanced call: a quad per glyph, textured from a single glyph atlas.
+// Lowercase is drawn as uppercase; characters outside the font show as '?'
+class TextOverlay {
+    public:
+    static const unsigned int MAX_GLYPHS = 4096; // Queued per frame; further text is dropped
+    static const unsigned int GLYPH_SCALE = 2; // Screen pixels per font pixel
+
+    TextOverlay() = default;
+    TextOverlay(const TextOverlay&) = delete;
+    TextOverlay& operator=(const TextOverlay&) = delete;
+
+    // 'program' is the linked overlay_vertex.glsl / overlay_fragment.glsl pair
+    bool create(const ShaderProgram& program);
+    void destroy();
+
+    // Drop the queued text
+    void clear();
+    // Queue 'text' with its top-left corner at pixel (x, y), measured from the top-left of the window.
+    // '\n' starts a new line
+    void print(float x, float y, const char* text);
+    float lineHeight() const;
+
+    // Draw the queued text over the frame. Does not clear it, so static text can be drawn every frame
+    void draw(int screenWidth, int screenHeight);
+
+    private:
+    struct GlyphInstance {
+        float x;
+        float y;
+        uint32_t glyph;
+        uint32_t padding;
+    };
+
+    GlyphInstance glyphs[MAX_GLYPHS];
+    unsigned int glyphCount = 0;
+
+    const ShaderProgram* program = nullptr;
+    int screenSizeLocation = -1;
+    unsigned int atlas = 0;
+    unsigned int vao = 0;
+    StreamBuffer instances;
+};
+
+#endif
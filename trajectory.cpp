@@ -0,0 +1,463 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "trajectory.hpp"
+
+// Chunk buffers per writer: one being filled, the others queued for or being written to disk
+static const unsigned int TRAJECTORY_BUFFERS = 3;
+
+struct TrajectoryHeader {
+    char magic[8]; // "GRAVTRAJ"
+    uint32_t version;
+    uint32_t fields; // TrajectoryField flags
+    uint64_t bodyCount;
+    uint32_t framesPerChunk;
+    uint32_t reserved0;
+    uint64_t reserved[4];
+};
+static_assert(sizeof(TrajectoryHeader) == 64, "the header fills 64 bytes");
+
+struct TrajectoryChunkHeader {
+    char magic[4]; // "CHNK"
+    uint32_t frameCount; // framesPerChunk, except in the last chunk
+    uint64_t firstFrame;
+    uint64_t size; // Of the whole chunk, this header included
+};
+
+// Codecs of field blocks
+enum TrajectoryCodec : uint32_t {
+    TRAJECTORY_CODEC_RAW = 0, // Plain little-endian values
+    TRAJECTORY_CODEC_LOSSLESS = 1, // ParticleCodec::encodeLossless over the frames of the block
+    TRAJECTORY_CODEC_LOSSY = 2, // ParticleCodec::encodeLossy, vec3 fields only
+};
+
+// Precedes the data of one field in a chunk
+struct TrajectoryBlock {
+    uint32_t field; // One TrajectoryField
+    uint32_t codec; // TrajectoryCodec
+    uint64_t rawSize; // Bytes once decoded: frames * bodies * element size
+    uint64_t storedSize; // Bytes that follow in the file
+};
+
+struct TrajectoryFooter {
+    char magic[8]; // "GRAVTIDX"
+    uint64_t indexOffset; // Chunk offsets (uint64_t each), then a TrajectoryFrameTime per frame
+    uint64_t chunkCount;
+    uint64_t frameCount;
+};
+
+// In the order fields are stored in
+static const TrajectoryField FIELDS[] = {TRAJECTORY_POSITION, TRAJECTORY_VELOCITY, TRAJECTORY_RADIUS, TRAJECTORY_MASS};
+
+static size_t elementSize(TrajectoryField field) {
+    return field == TRAJECTORY_POSITION || field == TRAJECTORY_VELOCITY ? sizeof(glm::vec3) : sizeof(float);
+}
+
+// Bytes of one frame of all selected fields
+static size_t frameBytes(uint32_t fields, size_t bodyCount) {
+    size_t bytes = 0;
+    for (TrajectoryField field : FIELDS) {
+        if (fields & field) bytes += elementSize(field) * bodyCount;
+    }
+    return bytes;
+}
+
+bool TrajectoryWriter::open(const char* path, size_t bodyCount, const TrajectoryOptions& options) {
+    close();
+    uint32_t fields = options.fields & TRAJECTORY_FULL_STATE;
+    uint32_t framesPerChunk = options.framesPerChunk;
+    if (fields == 0 || framesPerChunk == 0) {
+        std::cerr << "Trajectory " << path << ": no fields selected\n";
+        return false;
+    }
+    if (options.compression == TRAJECTORY_LOSSY && !(options.tolerance > 0.f && std::isfinite(options.tolerance))) {
+        std::cerr << "Trajectory " << path << ": the tolerance must be a positive number\n";
+        return false;
+    }
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Trajectory " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    this->bodyCount = bodyCount;
+    this->fields = fields;
+    this->framesPerChunk = framesPerChunk;
+    compression = options.compression;
+    tolerance = options.tolerance;
+    compressionPool.reset();
+    if (compression != TRAJECTORY_UNCOMPRESSED) {
+        compressionPool.reset(new WorkerPool(std::max(1u, options.compressionThreads) - 1));
+    }
+    failed = false;
+    stallCount = 0;
+    closing = false;
+    chunkOffsets.clear();
+    frameTimes.clear();
+
+    TrajectoryHeader header = {};
+    std::memcpy(header.magic, "GRAVTRAJ", 8);
+    header.version = TRAJECTORY_VERSION;
+    header.fields = fields;
+    header.bodyCount = bodyCount;
+    header.framesPerChunk = framesPerChunk;
+    fileOffset = 0;
+    if (!writeAll(&header, sizeof(header))) {
+        std::cerr << "Trajectory " << path << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Every buffer is allocated here, so appending never does
+    chunks.clear();
+    freeChunks.clear();
+    fullChunks.clear();
+    freeChunks.reserve(TRAJECTORY_BUFFERS);
+    fullChunks.reserve(TRAJECTORY_BUFFERS);
+    for (unsigned int i = 0; i < TRAJECTORY_BUFFERS; i++) {
+        chunks.emplace_back(new Chunk());
+        chunks.back()->data.resize(frameBytes(fields, bodyCount) * framesPerChunk);
+        chunks.back()->frames.reserve(framesPerChunk);
+        freeChunks.push_back(chunks.back().get());
+    }
+    filling = freeChunks.back();
+    freeChunks.pop_back();
+    thread = std::thread(&TrajectoryWriter::writerLoop, this);
+    return true;
+}
+
+void TrajectoryWriter::append(const std::vector<Sphere>& spheres, uint64_t step, double simTime) {
+    if (fd < 0 || spheres.size() != bodyCount) return;
+
+    // Field-major: frame f of a field sits at that field's base plus f frames of it
+    size_t frame = filling->frames.size();
+    unsigned char* base = filling->data.data();
+    for (TrajectoryField field : FIELDS) {
+        if (!(fields & field)) continue;
+        size_t size = elementSize(field);
+        unsigned char* out = base + frame * size * bodyCount;
+        for (const Sphere &sphere : spheres) {
+            const void* value = field == TRAJECTORY_POSITION ? (const void*)&sphere.pos
+                              : field == TRAJECTORY_VELOCITY ? (const void*)&sphere.vel
+                              : field == TRAJECTORY_RADIUS ? (const void*)&sphere.radius : (const void*)&sphere.mass;
+            std::memcpy(out, value, size);
+            out += size;
+        }
+        base += size * bodyCount * framesPerChunk;
+    }
+    filling->frames.push_back({step, simTime});
+    if (filling->frames.size() < framesPerChunk) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    fullChunks.push_back(filling);
+    changed.notify_all();
+    if (freeChunks.empty()) {
+        stallCount++;
+        changed.wait(lock, [this] { return !freeChunks.empty(); });
+    }
+    filling = freeChunks.back();
+    freeChunks.pop_back();
+}
+
+bool TrajectoryWriter::close() {
+    if (fd < 0) return true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!filling->frames.empty()) fullChunks.push_back(filling);
+        filling = nullptr;
+        closing = true;
+    }
+    changed.notify_all();
+    thread.join();
+
+    TrajectoryFooter footer = {};
+    std::memcpy(footer.magic, "GRAVTIDX", 8);
+    footer.indexOffset = fileOffset;
+    footer.chunkCount = chunkOffsets.size();
+    footer.frameCount = frameTimes.size();
+    bool ok = !failed && writeAll(chunkOffsets.data(), chunkOffsets.size() * sizeof(uint64_t)) &&
+              writeAll(frameTimes.data(), frameTimes.size() * sizeof(TrajectoryFrameTime)) && writeAll(&footer, sizeof(footer));
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+    chunks.clear();
+    freeChunks.clear();
+    compressionPool.reset();
+    if (!ok) std::cerr << "Trajectory: write failed, the file is incomplete\n";
+    return ok;
+}
+
+void TrajectoryWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return closing || !fullChunks.empty(); });
+        if (fullChunks.empty()) return;
+        Chunk* chunk = fullChunks.front();
+        lock.unlock();
+        // After a failed write, chunks are only recycled; an index past a gap would be wrong
+        if (!failed) failed = !writeChunk(*chunk);
+        chunk->frames.clear();
+        lock.lock();
+        fullChunks.erase(fullChunks.begin());
+        freeChunks.push_back(chunk);
+        changed.notify_all();
+    }
+}
+
+bool TrajectoryWriter::writeChunk(const Chunk& chunk) {
+    uint64_t frameCount = chunk.frames.size();
+    TrajectoryChunkHeader header = {};
+    std::memcpy(header.magic, "CHNK", 4);
+    header.frameCount = frameCount;
+    header.firstFrame = frameTimes.size();
+    header.size = sizeof(header) + frameCount * sizeof(TrajectoryFrameTime);
+    if (compression != TRAJECTORY_UNCOMPRESSED) {
+        encodeChunk(chunk);
+        header.size += encoded.size();
+    } else {
+        for (TrajectoryField field : FIELDS) {
+            if (fields & field) header.size += sizeof(TrajectoryBlock) + frameCount * elementSize(field) * bodyCount;
+        }
+    }
+
+    uint64_t offset = fileOffset;
+    if (!writeAll(&header, sizeof(header)) || !writeAll(chunk.frames.data(), frameCount * sizeof(TrajectoryFrameTime))) {
+        return false;
+    }
+    if (compression != TRAJECTORY_UNCOMPRESSED) {
+        if (!writeAll(encoded.data(), encoded.size())) return false;
+    } else {
+        // Plain blocks go straight from the chunk buffer
+        const unsigned char* base = chunk.data.data();
+        for (TrajectoryField field : FIELDS) {
+            if (!(fields & field)) continue;
+            size_t fieldBytes = elementSize(field) * bodyCount;
+            TrajectoryBlock block = {field, TRAJECTORY_CODEC_RAW, frameCount * fieldBytes, frameCount * fieldBytes};
+            if (!writeAll(&block, sizeof(block)) || !writeAll(base, block.storedSize)) return false;
+            base += fieldBytes * framesPerChunk;
+        }
+    }
+    chunkOffsets.push_back(offset);
+    frameTimes.insert(frameTimes.end(), chunk.frames.begin(), chunk.frames.end());
+    return true;
+}
+
+void TrajectoryWriter::encodeChunk(const Chunk& chunk) {
+    uint64_t frameCount = chunk.frames.size();
+    encoded.clear();
+    const unsigned char* base = chunk.data.data();
+    for (TrajectoryField field : FIELDS) {
+        if (!(fields & field)) continue;
+        size_t fieldBytes = elementSize(field) * bodyCount;
+        // The block header goes in front once the stored size is known
+        size_t blockOffset = encoded.size();
+        encoded.resize(blockOffset + sizeof(TrajectoryBlock));
+        size_t frameWords = fieldBytes / sizeof(uint32_t);
+        // Lossy falls back to lossless for frames it cannot bound, e.g. with bodies that blew up to infinity
+        TrajectoryCodec blockCodec = TRAJECTORY_CODEC_LOSSLESS;
+        if (compression == TRAJECTORY_LOSSY && field == TRAJECTORY_POSITION &&
+            codec.encodeLossy(reinterpret_cast<const float*>(base), frameCount, frameWords, 3, tolerance, encoded,
+                              *compressionPool)) {
+            blockCodec = TRAJECTORY_CODEC_LOSSY;
+        } else {
+            codec.encodeLossless(reinterpret_cast<const uint32_t*>(base), frameCount, frameWords, encoded, *compressionPool);
+        }
+        TrajectoryBlock block = {field, blockCodec, frameCount * fieldBytes,
+                                 encoded.size() - blockOffset - sizeof(TrajectoryBlock)};
+        std::memcpy(encoded.data() + blockOffset, &block, sizeof(block));
+        base += fieldBytes * framesPerChunk;
+    }
+}
+
+bool TrajectoryWriter::writeAll(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t result = ::write(fd, bytes, size);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        bytes += result;
+        size -= result;
+        fileOffset += result;
+    }
+    return true;
+}
+
+bool TrajectoryReader::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Trajectory " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(TrajectoryHeader)) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Trajectory " << path << ": cannot map the file\n";
+        return false;
+    }
+    file = static_cast<const unsigned char*>(mapping);
+    fileSize = info.st_size;
+
+    TrajectoryHeader header;
+    std::memcpy(&header, file, sizeof(header));
+    if (std::memcmp(header.magic, "GRAVTRAJ", 8) != 0 || header.version != TRAJECTORY_VERSION || header.framesPerChunk == 0) {
+        std::cerr << "Trajectory " << path << ": not a trajectory of version " << TRAJECTORY_VERSION << "\n";
+        close();
+        return false;
+    }
+    bodies = header.bodyCount;
+    fieldMask = header.fields;
+    framesPerChunk = header.framesPerChunk;
+    if (!readIndex()) {
+        std::cerr << "Trajectory " << path << ": no index, scanning the chunks\n";
+        scanChunks();
+    }
+    return true;
+}
+
+void TrajectoryReader::close() {
+    if (file) munmap(const_cast<unsigned char*>(file), fileSize);
+    file = nullptr;
+    fileSize = 0;
+    chunkOffsets.clear();
+    frameTimes.clear();
+    for (DecodedBlock &block : decoded) block.offset = 0;
+}
+
+bool TrajectoryReader::readIndex() {
+    if (fileSize < sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter)) return false;
+    TrajectoryFooter footer;
+    std::memcpy(&footer, file + fileSize - sizeof(footer), sizeof(footer));
+    // Bounded before multiplying, so a damaged footer cannot wrap the index size or size an allocation
+    if (std::memcmp(footer.magic, "GRAVTIDX", 8) != 0 || footer.indexOffset < sizeof(TrajectoryHeader) ||
+        footer.indexOffset > fileSize || footer.chunkCount > fileSize / sizeof(uint64_t) ||
+        footer.frameCount > fileSize / sizeof(TrajectoryFrameTime)) {
+        return false;
+    }
+    uint64_t indexSize = footer.chunkCount * sizeof(uint64_t) + footer.frameCount * sizeof(TrajectoryFrameTime);
+    if (footer.indexOffset + indexSize + sizeof(footer) != fileSize ||
+        footer.chunkCount != (footer.frameCount + framesPerChunk - 1) / framesPerChunk) {
+        return false;
+    }
+    chunkOffsets.resize(footer.chunkCount);
+    frameTimes.resize(footer.frameCount);
+    std::memcpy(chunkOffsets.data(), file + footer.indexOffset, chunkOffsets.size() * sizeof(uint64_t));
+    std::memcpy(frameTimes.data(), file + footer.indexOffset + chunkOffsets.size() * sizeof(uint64_t),
+                frameTimes.size() * sizeof(TrajectoryFrameTime));
+    for (uint64_t offset : chunkOffsets) {
+        if (offset > footer.indexOffset - sizeof(TrajectoryChunkHeader)) return false;
+    }
+    return true;
+}
+
+void TrajectoryReader::scanChunks() {
+    chunkOffsets.clear();
+    frameTimes.clear();
+    uint64_t offset = sizeof(TrajectoryHeader);
+    while (offset + sizeof(TrajectoryChunkHeader) <= fileSize) {
+        TrajectoryChunkHeader header;
+        std::memcpy(&header, file + offset, sizeof(header));
+        // Stops at the first chunk that was not written completely
+        if (std::memcmp(header.magic, "CHNK", 4) != 0 || header.firstFrame != frameTimes.size() ||
+            header.frameCount == 0 || header.frameCount > framesPerChunk || header.size > fileSize - offset) {
+            break;
+        }
+        chunkOffsets.push_back(offset);
+        const unsigned char* times = file + offset + sizeof(header);
+        for (uint32_t f = 0; f < header.frameCount; f++) {
+            TrajectoryFrameTime time;
+            std::memcpy(&time, times + f * sizeof(time), sizeof(time));
+            frameTimes.push_back(time);
+        }
+        offset += header.size;
+        // Only the last chunk may be short, or frame numbers would no longer map onto chunks
+        if (header.frameCount < framesPerChunk) break;
+    }
+}
+
+bool TrajectoryReader::readFrame(uint64_t frame, TrajectoryFrame& out) const {
+    if (frame >= frameTimes.size()) return false;
+    uint64_t offset = chunkOffsets[frame / framesPerChunk];
+    uint64_t inChunk = frame % framesPerChunk;
+    TrajectoryChunkHeader header;
+    std::memcpy(&header, file + offset, sizeof(header));
+    if (header.size > fileSize - offset || inChunk >= header.frameCount) return false;
+    uint64_t end = offset + header.size;
+
+    out.step = frameTimes[frame].step;
+    out.simTime = frameTimes[frame].simTime;
+    out.positions.clear();
+    out.velocities.clear();
+    out.radii.clear();
+    out.masses.clear();
+
+    offset += sizeof(header) + header.frameCount * sizeof(TrajectoryFrameTime);
+    while (offset + sizeof(TrajectoryBlock) <= end) {
+        TrajectoryBlock block;
+        std::memcpy(&block, file + offset, sizeof(block));
+        offset += sizeof(block);
+        if (block.storedSize > end - offset) return false;
+        size_t size = elementSize(TrajectoryField(block.field));
+        size_t fieldBytes = size * bodies;
+        if (block.rawSize != header.frameCount * fieldBytes) return false;
+        const unsigned char* values = nullptr;
+        if (block.codec == TRAJECTORY_CODEC_RAW && block.storedSize == block.rawSize) {
+            values = file + offset + inChunk * fieldBytes;
+        } else if (block.codec == TRAJECTORY_CODEC_LOSSLESS || block.codec == TRAJECTORY_CODEC_LOSSY) {
+            unsigned int slot = 0;
+            while (slot < 4 && FIELDS[slot] != block.field) slot++;
+            if (slot == 4) return false;
+            const uint32_t* words = decodeBlock(slot, block.codec, offset, block.storedSize, header.frameCount, fieldBytes / sizeof(uint32_t));
+            if (!words) return false;
+            values = reinterpret_cast<const unsigned char*>(words) + inChunk * fieldBytes;
+        } else {
+            return false;
+        }
+        switch (block.field) {
+            case TRAJECTORY_POSITION:
+                out.positions.resize(bodies);
+                std::memcpy(out.positions.data(), values, fieldBytes);
+                break;
+            case TRAJECTORY_VELOCITY:
+                out.velocities.resize(bodies);
+                std::memcpy(out.velocities.data(), values, fieldBytes);
+                break;
+            case TRAJECTORY_RADIUS:
+                out.radii.resize(bodies);
+                std::memcpy(out.radii.data(), values, fieldBytes);
+                break;
+            case TRAJECTORY_MASS:
+                out.masses.resize(bodies);
+                std::memcpy(out.masses.data(), values, fieldBytes);
+                break;
+        }
+        offset += block.storedSize;
+    }
+    return true;
+}
+
+const uint32_t* TrajectoryReader::decodeBlock(unsigned int slot, uint32_t blockCodec, uint64_t offset, size_t size,
+                                              size_t frameCount, size_t frameWords) const {
+    DecodedBlock &block = decoded[slot];
+    if (block.offset == offset) return block.words.data();
+    block.offset = 0;
+    block.words.resize(frameCount * frameWords);
+    // Lossy values are floats; the cache holds their bits like any other field
+    bool ok = blockCodec == TRAJECTORY_CODEC_LOSSY
+            ? codec.decodeLossy(file + offset, size, frameCount, frameWords, reinterpret_cast<float*>(block.words.data()))
+            : codec.decodeLossless(file + offset, size, frameCount, frameWords, block.words.data());
+    if (!ok) return nullptr;
+    block.offset = offset;
+    return block.words.data();
+}
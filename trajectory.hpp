@@ -0,0 +1,183 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "particle_codec.hpp"
+#include "physics.hpp"
+#include "task_graph.hpp"
+
+// Trajectory file: the bodies of many steps, for analysis after the run. Frames are grouped into
+// chunks of a fixed number of frames, written one after the other while the run goes on:
+//
+//   header                                        64 bytes
+//   chunk: header, step and time of each frame,
+//          then per selected field one block      field-major: every frame of positions, then velocities, ...
+//   ...
+//   index: offset of every chunk, step and time of every frame
+//   footer                                        where the index starts; always the last 32 bytes
+//
+// Frame f is in chunk f / framesPerChunk, so a reader finds any frame with two lookups. A file whose
+// writer died before the index was written is still readable: its complete chunks are scanned instead.
+// Each block names its codec, so blocks may be stored plain or compressed with ParticleCodec.
+// Little-endian, like checkpoints
+
+const uint32_t TRAJECTORY_VERSION = 1;
+const uint32_t TRAJECTORY_FRAMES_PER_CHUNK = 16;
+
+// Per-body fields a trajectory can hold, as bit flags
+enum TrajectoryField : uint32_t {
+    TRAJECTORY_POSITION = 1,
+    TRAJECTORY_VELOCITY = 2,
+    TRAJECTORY_RADIUS = 4,
+    TRAJECTORY_MASS = 8,
+};
+const uint32_t TRAJECTORY_POSITIONS_ONLY = TRAJECTORY_POSITION;
+const uint32_t TRAJECTORY_FULL_STATE = TRAJECTORY_POSITION | TRAJECTORY_VELOCITY | TRAJECTORY_RADIUS | TRAJECTORY_MASS;
+
+// How field blocks are stored
+enum TrajectoryCompression : uint32_t {
+    TRAJECTORY_UNCOMPRESSED,
+    TRAJECTORY_LOSSLESS, // ParticleCodec::encodeLossless, bit-exact
+    TRAJECTORY_LOSSY, // Positions with ParticleCodec::encodeLossy, every other field lossless
+};
+
+struct TrajectoryOptions {
+    uint32_t fields = TRAJECTORY_POSITIONS_ONLY; // Combination of TrajectoryField
+    TrajectoryCompression compression = TRAJECTORY_UNCOMPRESSED;
+    float tolerance = 1e-4f; // Largest position error of TRAJECTORY_LOSSY, in world units
+    unsigned int compressionThreads = 1; // Threads encoding a chunk, the writer thread included
+    uint32_t framesPerChunk = TRAJECTORY_FRAMES_PER_CHUNK;
+};
+
+// Step and simulated time of one frame, as stored in chunks and the index
+struct TrajectoryFrameTime {
+    uint64_t step;
+    double simTime;
+};
+
+// Streams frames to a trajectory file from a background thread. append() only copies the bodies
+// into a chunk buffer; full chunks are handed to the thread, which writes them while stepping goes on.
+// Only when every buffer is still waiting for the disk does append() block. Three chunks are
+// buffered, so memory is 3 * framesPerChunk frames of the selected fields. Compression also runs on
+// the writer thread, with a pool of its own, so it only slows stepping down if it falls behind
+class TrajectoryWriter {
+    public:
+    TrajectoryWriter() = default;
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+    ~TrajectoryWriter() { close(); }
+
+    // Returns false, after printing to stderr, if the file cannot be created
+    bool open(const char* path, size_t bodyCount, const TrajectoryOptions& options);
+    // One frame. The body count must be the one given to open(). Does not allocate
+    void append(const std::vector<Sphere>& spheres, uint64_t step, double simTime);
+    // Write what is buffered and the index. Returns false if any write failed
+    bool close();
+
+    bool isOpen() const { return fd >= 0; }
+    // Times append() had to wait for the disk
+    uint64_t stalls() const { return stallCount; }
+
+    private:
+    // Frames of one chunk, field-major
+    struct Chunk {
+        std::vector<unsigned char> data;
+        std::vector<TrajectoryFrameTime> frames;
+    };
+
+    void writerLoop();
+    bool writeChunk(const Chunk& chunk);
+    // Compress every field block of 'chunk' into 'encoded'
+    void encodeChunk(const Chunk& chunk);
+    bool writeAll(const void* data, size_t size);
+
+    int fd = -1;
+    size_t bodyCount = 0;
+    uint32_t fields = 0;
+    uint32_t framesPerChunk = 0;
+    TrajectoryCompression compression = TRAJECTORY_UNCOMPRESSED;
+    float tolerance = 0.f;
+    std::unique_ptr<WorkerPool> compressionPool; // Writer thread only, as are the two below
+    ParticleCodec codec;
+    std::vector<unsigned char> encoded; // Blocks of the chunk being written, when compressed
+    uint64_t fileOffset = 0; // Writer thread only, until it is joined
+    std::vector<uint64_t> chunkOffsets; // Writer thread only, until it is joined
+    std::vector<TrajectoryFrameTime> frameTimes; // Writer thread only, until it is joined
+    bool failed = false; // Writer thread only, until it is joined
+    uint64_t stallCount = 0;
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    Chunk* filling = nullptr; // Stepping thread only
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Chunk*> freeChunks; // Guarded by mutex, as are the two below
+    std::vector<Chunk*> fullChunks; // In file order
+    bool closing = false;
+    std::thread thread;
+};
+
+// One frame read back; the vectors of fields the file does not hold stay empty
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    double simTime = 0.0;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> radii;
+    std::vector<float> masses;
+};
+
+// Random access to the frames of a trajectory file, which is memory-mapped. Compressed blocks are
+// decoded a whole chunk at a time and the last one of each field kept, so reading frames in order
+// decodes every chunk once. Not safe to use from several threads at once
+class TrajectoryReader {
+    public:
+    TrajectoryReader() = default;
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+    ~TrajectoryReader() { close(); }
+
+    // Returns false, after printing to stderr, if the file is missing or not a trajectory
+    bool open(const char* path);
+    void close();
+
+    size_t bodyCount() const { return bodies; }
+    uint32_t fields() const { return fieldMask; }
+    uint64_t frameCount() const { return frameTimes.size(); }
+    const TrajectoryFrameTime& frameTime(uint64_t frame) const { return frameTimes[frame]; }
+    // Returns false if the frame is out of range or its chunk is damaged
+    bool readFrame(uint64_t frame, TrajectoryFrame& out) const;
+
+    private:
+    bool readIndex();
+    void scanChunks();
+    // Words of the block at 'offset' of the file, decoded; nullptr if it is damaged
+    const uint32_t* decodeBlock(unsigned int slot, uint32_t blockCodec, uint64_t offset, size_t size, size_t frameCount,
+                                size_t frameWords) const;
+
+    const unsigned char* file = nullptr;
+    uint64_t fileSize = 0;
+    size_t bodies = 0;
+    uint32_t fieldMask = 0;
+    uint32_t framesPerChunk = 0;
+    std::vector<uint64_t> chunkOffsets;
+    std::vector<TrajectoryFrameTime> frameTimes;
+
+    // Last decoded block per field, in FIELDS order
+    struct DecodedBlock {
+        uint64_t offset = 0; // In the file; 0 when empty, no block starts there
+        std::vector<uint32_t> words;
+    };
+    mutable DecodedBlock decoded[4];
+    mutable ParticleCodec codec;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+// Lock-free single-producer / single-consumer triple buffer.
+// The writer fills its back buffer and publishes it by swapping it with the shared middle slot;
+// the reader swaps the middle slot with its front buffer when something new was published.
+// Neither side ever waits, and the reader always sees the most recent complete buffer.
+template <typename T>
+class TripleBuffer {
+    public:
+    // Buffer owned by the writer
+    T& writeBuffer() { return buffers[back]; }
+
+    // Hand the write buffer to the reader. The writer continues with the old middle buffer,
+    // whose contents are stale but whose storage can be reused
+    void publish() {
+        back = middle.exchange(back | DIRTY, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Take the latest published buffer, if there is one newer than the current front buffer.
+    // Returns false if nothing new was published
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Buffer owned by the reader
+    const T& readBuffer() const { return buffers[front]; }
+
+    private:
+    static const unsigned int INDEX_MASK = 3;
+    static const unsigned int DIRTY = 4; // Middle holds a buffer the reader has not taken yet
+
+    T buffers[3];
+    unsigned int front = 0; // Reader side only
+    unsigned int back = 1; // Writer side only
+    std::atomic<unsigned int> middle{2};
+};
+
+#endif
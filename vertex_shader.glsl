@@ -1,16 +1,20 @@
 #version 330 core
-layout(location=0) in vec3 aPos; // Vertex position
-//layout(location=1) in vec3 aColor; // Vertex color
+layout(location=0) in vec3 aPos; // Vertex position (unit sphere)
+layout(location=1) in vec4 aInstance; // Per-instance: xyz = sphere position, w = radius
+layout(location=2) in vec4 aColor; // Per-instance color
+layout(location=3) in vec3 aPrevPos; // Per-instance: sphere position one physics step earlier
 
-uniform mat4 model; // Object transformation
-uniform mat4 view; // Camera transformation
-uniform mat4 projection; // Perspective projection
-uniform float radius; // Sphere radius
+layout(std140) uniform Frame { // Updated once per frame, shared by all programs
+    mat4 view; // Camera transformation
+    mat4 projection; // Perspective projection
+    float interpolation; // 0 = previous physics step, 1 = latest step
+};
 
 out vec3 vertexColor; // Passed to fragment shader
 
 void main() {
-    vec3 scaledPos = aPos * radius; // Scale the vertex
-    gl_Position = projection * view * model * vec4(scaledPos, 1.0);
-    vertexColor = vec3(0.1686, 0.7529, 0.051);
-}
\ No newline at end of file
+    vec3 center = mix(aPrevPos, aInstance.xyz, interpolation); // Smooth motion between physics steps
+    vec3 worldPos = aPos * aInstance.w + center; // Scale the vertex, then move it to the sphere
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+    vertexColor = aColor.rgb;
+}
@@ -0,0 +1,65 @@
+#include "visible_instances.hpp"
+
+Frustum extractFrustum(const glm::mat4 &viewProjection) {
+    // glm is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum;
+    for (int i = 0; i < 3; i++) {
+        frustum.planes[2 * i] = rows[3] + rows[i];
+        frustum.planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (auto &plane : frustum.planes)
+        plane = plane * (1.f / glm::length(glm::vec3(plane.x, plane.y, plane.z)));
+    return frustum;
+}
+
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius) {
+    for (const auto &plane : frustum.planes) {
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+size_t writeVisibleInstances(const std::vector<BodyState> &spheres, const Frustum &frustum, const glm::mat4 &view, float pixelsPerUnit,
+                             std::vector<unsigned char> &sphereLod, InstanceData* out,
+                             unsigned int lodFirst[SPHERE_LOD_COUNT], unsigned int lodCount[SPHERE_LOD_COUNT]) {
+    const unsigned char CULLED = SPHERE_LOD_COUNT;
+    sphereLod.resize(spheres.size());
+    for (unsigned int level = 0; level < SPHERE_LOD_COUNT; level++) lodCount[level] = 0;
+
+    // Pass 1: classify every sphere and count the size of each bucket
+    for (size_t i = 0; i < spheres.size(); i++) {
+        const BodyState &sphere = spheres[i];
+        // The shader draws somewhere between prevPos and pos; grow the bound to cover both
+        float cullRadius = sphere.radius + glm::length(sphere.pos - sphere.prevPos);
+        if (!sphereInFrustum(frustum, sphere.pos, cullRadius)) {
+            sphereLod[i] = CULLED;
+            continue;
+        }
+        // Depth along the view axis; the camera looks down -z
+        float depth = -(view[0][2] * sphere.pos.x + view[1][2] * sphere.pos.y + view[2][2] * sphere.pos.z + view[3][2]);
+        float screenRadius = depth > sphere.radius ? sphere.radius * pixelsPerUnit / depth : 1e9f;
+        unsigned int level = selectSphereLod(screenRadius);
+        sphereLod[i] = level;
+        lodCount[level]++;
+    }
+
+    // Pass 2: scatter into the bucket ranges
+    unsigned int next[SPHERE_LOD_COUNT];
+    unsigned int total = 0;
+    for (unsigned int level = 0; level < SPHERE_LOD_COUNT; level++) {
+        lodFirst[level] = next[level] = total;
+        total += lodCount[level];
+    }
+    for (size_t i = 0; i < spheres.size(); i++) {
+        if (sphereLod[i] == CULLED) continue;
+        const BodyState &sphere = spheres[i];
+        // Coherent mapping: the write is visible to the GPU without a flush or copy
+        out[next[sphereLod[i]]++] = {glm::vec4(sphere.pos, sphere.radius), glm::vec4(sphere.color, 1.f), glm::vec4(sphere.prevPos, 0.f)};
+    }
+    return total;
+}
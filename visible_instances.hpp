@@ -0,0 +1,39 @@
+#ifndef VISIBLE_INSTANCES_HPP
+#define VISIBLE_INSTANCES_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "physics_thread.hpp"
+#include "sphere_mesh.hpp"
+
+// Per-frame culling and LOD selection of the bodies, feeding the instanced draws. No GL calls, so
+// headless checks can run it too
+
+// Per-instance data, one entry per sphere. Matches attributes 1-3 in the vertex shaders
+struct InstanceData {
+    glm::vec4 posRadius; // xyz = world position, w = radius
+    glm::vec4 color;
+    glm::vec4 prevPos; // xyz = world position one physics step earlier
+};
+
+// View-frustum planes as (normal, distance); a point p is inside when dot(normal, p) + distance >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb-Hartmann plane extraction from the combined projection * view matrix
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius);
+
+// Cull bodies against the frustum and write the visible ones to 'out', grouped by LOD level
+// so each level is one contiguous instance range. 'sphereLod' is per-sphere scratch space.
+// Returns the number of instances written.
+size_t writeVisibleInstances(const std::vector<BodyState> &spheres, const Frustum &frustum, const glm::mat4 &view, float pixelsPerUnit,
+                             std::vector<unsigned char> &sphereLod, InstanceData* out,
+                             unsigned int lodFirst[SPHERE_LOD_COUNT], unsigned int lodCount[SPHERE_LOD_COUNT]);
+
+#endif